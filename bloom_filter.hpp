@@ -0,0 +1,149 @@
+/**
+ * Blocked Bloom Filter
+ *
+ * Set membership filter with no false negatives and a tunable false
+ * positive rate. All bits for one item sit in a single 512 bit block, so a
+ * query reads one 64 byte block (one or two cache lines) instead of k
+ * scattered words. Items are given as hash values; BST uses std::hash.
+ * Items cannot be removed, the owner rebuilds the filter instead.
+ */
+
+#ifndef BLOOM_FILTER_HPP
+#define BLOOM_FILTER_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class BlockedBloomFilter {
+ public:
+    BlockedBloomFilter() = default;
+
+    /**
+     * Empties the filter and sizes it for capacity items at about fpRate
+     * false positives
+     * @param capacity - number of items expected, at least 1 is assumed
+     * @param fpRate - target false positive rate, clamped by ClampRate
+     */
+    void Reset(size_t capacity, double fpRate) {
+        if (capacity < 1) capacity = 1;
+        fpRate = ClampRate(fpRate);
+        // standard sizing: -ln(p) / ln(2)^2 bits per item, and ln(2) hashes
+        // per bit of that
+        double ln2 = log(2.0);
+        double bitsPerItem = -log(fpRate) / (ln2 * ln2);
+        size_t numBlocks = static_cast<size_t>(
+                ceil(capacity * bitsPerItem / BLOCK_BITS));
+        if (numBlocks < 1) numBlocks = 1;
+        numHashes = static_cast<int>(lround(bitsPerItem * ln2));
+        if (numHashes < 1) numHashes = 1;
+        if (numHashes > 16) numHashes = 16;
+        words.assign(numBlocks * BLOCK_WORDS, 0);
+        setBits = 0;
+        // fill level at which the estimated rate doubles the target
+        maxSetBits = static_cast<size_t>(
+                words.size() * 64 * pow(2 * fpRate, 1.0 / numHashes));
+    }
+
+    // fpRate limited to [MIN_RATE, MAX_RATE]: a rate of 0 or less would ask
+    // for infinitely many bits, and above MAX_RATE the filter rejects
+    // too few misses to pay for itself. NaN gives MAX_RATE
+    static double ClampRate(double fpRate) {
+        if (!(fpRate <= MAX_RATE)) return MAX_RATE;
+        if (fpRate < MIN_RATE) return MIN_RATE;
+        return fpRate;
+    }
+
+    // add an item by its hash
+    void Insert(size_t hash) {
+        if (words.empty()) {
+            return;
+        }
+        uint64_t* block = &words[blockStart(hash)];
+        uint64_t h = mix(hash);
+        uint32_t h1 = static_cast<uint32_t>(h);
+        uint32_t h2 = static_cast<uint32_t>(h >> 32) | 1;
+        for (int i = 0; i < numHashes; i++) {
+            uint32_t bit = (h1 + i * h2) % BLOCK_BITS;
+            uint64_t mask = uint64_t(1) << (bit % 64);
+            if (!(block[bit / 64] & mask)) {
+                block[bit / 64] |= mask;
+                setBits++;
+            }
+        }
+    }
+
+    // false if the item was never inserted, true if it probably was
+    bool MayContain(size_t hash) const {
+        if (words.empty()) {
+            return false;
+        }
+        const uint64_t* block = &words[blockStart(hash)];
+        uint64_t h = mix(hash);
+        uint32_t h1 = static_cast<uint32_t>(h);
+        uint32_t h2 = static_cast<uint32_t>(h >> 32) | 1;
+        for (int i = 0; i < numHashes; i++) {
+            uint32_t bit = (h1 + i * h2) % BLOCK_BITS;
+            if (!(block[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // estimated false positive rate for the current fill level
+    double FalsePositiveRate() const {
+        if (words.empty()) {
+            return 0;
+        }
+        return pow(static_cast<double>(setBits) / (words.size() * 64),
+                   numHashes);
+    }
+
+    // true once the filter is so full its rate is twice the target
+    bool IsOverfull() const {
+        return setBits > maxSetBits;
+    }
+
+    // bytes held by the filter's bits
+    size_t MemoryUsage() const {
+        return words.capacity() * sizeof(uint64_t);
+    }
+
+ private:
+    static const int BLOCK_BITS = 512;
+    static const int BLOCK_WORDS = BLOCK_BITS / 64;
+    static constexpr double MIN_RATE = 1e-6;
+    static constexpr double MAX_RATE = 0.5;
+
+    // the filter's bits, BLOCK_WORDS words per block
+    vector<uint64_t> words;
+
+    // bits set per item
+    int numHashes{1};
+
+    // number of bits set, and the limit IsOverfull() checks against
+    size_t setBits{0};
+    size_t maxSetBits{0};
+
+    // spreads the bits of a hash (std::hash of an int is the int itself)
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // index of the first word of the block an item's bits go in, chosen
+    // by a different mix of the hash than the bit positions
+    size_t blockStart(size_t hash) const {
+        size_t numBlocks = words.size() / BLOCK_WORDS;
+        return (mix(hash ^ 0x9e3779b97f4a7c15ULL) % numBlocks) * BLOCK_WORDS;
+    }
+};
+
+#endif  // BLOOM_FILTER_HPP
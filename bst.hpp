@@ -3,8 +3,19 @@
  *
  * Store values in a BST
  * Can use Inorder, Preorder and Postorder to traverse tree
+ * RangeTraverse visits only the items in [lo, hi]
  * Can use Add/Remove to modify tree
+ * RemoveIf/RemoveRange delete many items in one pass
+ * SetLazyDelete turns Remove into tombstoning with batched compaction
+ * SetWriteBuffer batches Add into sorted merges for insert-heavy bursts
+ * BST<T, true> keeps subtree hashes for O(1) equality checks and fast Diff
+ * SetMultiset keeps a count per node so duplicates share one node
  * Rebalance creates a balanced tree
+ * StartRebalance/RebalanceStep and ReclaimStep spread the O(n) work out
+ * SetBackgroundRelease frees dropped trees on a background thread
+ * SetPrefilter answers most Contains misses from a Bloom filter
+ * SetFingerSearch starts Contains and Add from the last position visited
+ * SetSelfAdjusting splays accessed keys to the root for skewed workloads
  *
  * @author Jenna Martin
  * @date January 24, 2019
@@ -13,42 +24,210 @@
 #ifndef BST_HPP
 #define BST_HPP
 
+#include <algorithm>
+#include <climits>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <type_traits>
+#include <vector>
+
+#include "bloom_filter.hpp"
+#include "reclaimer.hpp"
 
 using namespace std;
 
-template<class T>
+// subtree hash held by each node of a BST<T, true>. Nodes of a plain
+// BST<T> get the empty version, so they stay data, count and two pointers
+template<bool Hashed>
+struct BSTNodeHash {};
+
+template<>
+struct BSTNodeHash<true> {
+    size_t hash{0};
+};
+
+template<class T, bool Hashed = false>
 class BST {
+    // BSTMap<K, V> stores its entries in a BST and works on its nodes
+    template<class K, class V> friend class BSTMap;
+
+    // ShardedBST<T> copies items out of its shards when re-splitting
+    template<class U> friend class ShardedBST;
+
     // display a sideways ascii representation of tree
     friend ostream &operator<<(ostream &os, const BST &bst) {
+        bst.flush();
         bst.sideways(bst.rootPtr, 0, os);
         return os;
     }
 
  private:
     // Node for BST
-    typedef struct node {
+    // In a BST<T, true> the base adds the structural hash of the subtree
+    // rooted here, kept up to date only while hashing is enabled
+    typedef struct node : BSTNodeHash<Hashed> {
+        // a leaf holding one copy, data built straight from args (an item
+        // to copy or move, or T's constructor arguments)
+        template<class... Args>
+        explicit node(Args&&... args)
+                : data(std::forward<Args>(args)...), count(1),
+                  leftPtr(nullptr), rightPtr(nullptr) {}
+
         T data;
+        // copies of data held: 1, or more in multiset mode. 0 marks a
+        // tombstone left by a lazy Remove(), which lookups and traversals
+        // skip until compaction frees it
+        int count;
         struct node *leftPtr;
         struct node *rightPtr;
     } Node;
 
-    // root of the tree
-    Node *rootPtr{nullptr};
+    // root of the tree, mutable so a self-adjusting Contains() can splay
+    mutable Node *rootPtr{nullptr};
+
+    // when true, Contains() and Add() splay the accessed key to the root
+    bool selfAdjusting{false};
+
+    // Contains() only splays accesses that end deeper than this
+    int splayMinDepth{0};
+
+    // number of live items and of tombstoned nodes in the tree, mutable
+    // because merging the write buffer is allowed from const functions
+    mutable int liveCount{0};
+    mutable int deadCount{0};
+
+    // when true, Remove() only marks the node as a tombstone
+    bool lazyDelete{false};
+
+    // lazy mode compacts once tombstones exceed this share of all nodes
+    double maxDeadRatio{0.25};
+
+    // largest maxDeadRatio accepted; at 1 or more a tree of nothing but
+    // tombstones would never be compacted
+    static constexpr double MAX_DEAD_RATIO = 0.99;
+
+    // duplicate free items added but not yet merged into the tree: a sorted
+    // run of bufferSorted items followed by a short unsorted tail.
+    // Mutable so const readers that need the whole tree can merge it first
+    mutable vector<T> writeBuffer;
+
+    // length of the sorted run at the front of writeBuffer
+    mutable size_t bufferSorted{0};
+
+    // the tail is sorted into the run once it is longer than this and than
+    // the square root of the run, which bounds both the unsorted items Add
+    // and Contains scan and the run moves per Add to about sqrt(capacity)
+    static constexpr size_t BUFFER_TAIL = 64;
+
+    // buffered-write mode is on when this is > 0, the buffer is merged
+    // into the tree once it holds this many items
+    int bufferCapacity{0};
+
+    // when true, every node's hash covers its data, copy count and
+    // both subtrees, and each modifying function keeps it current.
+    // Only a BST<T, true> has hashes, and it starts with them on
+    bool hashing{Hashed};
+
+    // when true, adding an item already in the tree increments its node's
+    // count instead of being rejected
+    bool multiset{false};
+
+    // bumped by every change to the tree's items (not by splaying), so an
+    // incremental rebalance can tell its snapshot went stale. Only compared
+    // for equality, unsigned so wrapping around is well defined
+    mutable unsigned modCount{0};
+
+    // roots of detached subtrees waiting to be freed by ReclaimStep()
+    vector<node*> pendingFree;
+
+    // when true, Clear() and operator= detach the old nodes onto
+    // pendingFree instead of freeing them straight away
+    bool incrementalRelease{false};
+
+    // when true, detached nodes are freed on the Reclaimer's thread
+    bool backgroundRelease{false};
+
+    // when true, Contains() asks prefilter before descending the tree
+    bool prefiltering{false};
+
+    // every item added since the last rebuild, including removed ones
+    BlockedBloomFilter prefilter;
+
+    // target false positive rate of prefilter
+    double prefilterRate{0.01};
+
+    // items removed since the last rebuild, still set in prefilter
+    int prefilterStale{0};
 
-    // Make a new BST Node
-    Node *makeNode(const T &value) const {
+    // hashes items for prefilter, set by SetPrefilter() so only trees that
+    // use the filter need std::hash<T>
+    size_t (*prefilterHash)(const T &item){nullptr};
+
+    // when true, Contains() and Add() search from the finger
+    bool fingerSearch{false};
+
+    // one node on the finger's path, with the open range of items its
+    // subtree can hold (a null bound is unbounded)
+    struct FingerStep {
+        node* n;
+        const T* lo;
+        const T* hi;
+    };
+
+    // root-to-node path of the last finger search. Nodes have no parent
+    // pointers, so this path is what a search climbs back up. Mutable so
+    // Contains() can move it
+    mutable vector<FingerStep> finger;
+
+    // modCount when the finger was last valid; any other change to the
+    // items may have freed nodes on the path, splaying clears it
+    mutable unsigned fingerMods{0};
+
+    // incremental rebalance: live items are copied out a few at a time,
+    // then a balanced copy is built a few nodes at a time and swapped in
+    enum RebalancePhase { NOT_REBALANCING, COLLECTING, BUILDING };
+    RebalancePhase rebalancePhase{NOT_REBALANCING};
+
+    // modCount when the current rebalance started
+    unsigned rebalanceMods{0};
+
+    // items (and their counts) collected so far, in order
+    vector<T> rebuildItems;
+    vector<int> rebuildCounts;
+
+    // last node collected, nullptr before the first. Nodes are only freed
+    // by changes that bump modCount, which restart the collection
+    node* rebuildLast{nullptr};
+
+    // nodes still to collect, the next one on top, kept between steps
+    vector<node*> collectStack;
+
+    // set when collectStack no longer matches the tree's shape (splaying
+    // moves nodes between subtrees); the next step descends from the root
+    // again to the node after rebuildLast
+    mutable bool collectStale{true};
+
+    // pending subranges of rebuildItems for the postorder build; an
+    // expanded frame has its subtrees on buildResults already
+    struct BuildFrame {
+        int lo;
+        int hi;
+        bool expanded;
+    };
+    vector<BuildFrame> buildFrames;
+
+    // roots of finished subtrees of the copy being built
+    vector<node*> buildResults;
+
+    // Make a new BST Node, a leaf holding one copy of the item built from
+    // args; passing an rvalue moves it in, so T needs no default
+    // constructor or assignment
+    template<class... Args>
+    Node *makeNode(Args&&... args) const {
         // TODO(Jenna Martin)
-        // new node created
-        node *newNode =  new node();
-        // data assigned the value passed in
-        newNode->data = value;
-        // left pointer set to null (it's a leaf)
-        newNode->leftPtr = nullptr;
-        // right pointer set to null (it's a leaf)
-        newNode->rightPtr = nullptr;
-        return newNode;
+        return new node(std::forward<Args>(args)...);
     }
 
     // helper function for displaying tree sideways, works recursively
@@ -62,46 +241,17 @@ class BST {
             for (int i = level; i >= 0; i--)
                 os << indents;
 
-            // display information of object
-            os << current->data << endl;
+            // display information of object, tombstones are marked
+            if (current->count == 0)
+                os << "(" << current->data << ")" << endl;
+            else
+                os << current->data << endl;
             sideways(current->leftPtr, level, os);
         }
     }
 
     // Additional private functions
     // TODO(Jenna)
-    /**
-     * isLeaf helper function checks if the current node is a leaf (no children)
-     * @param n - the node that is being evaluated as a leaf
-     * @return boolean, true if there are no children, false if otherwise
-     */
-    static bool isLeaf(node *n) {
-        return (!n->leftPtr && !n->rightPtr);
-    }
-
-    /**
-     * This helper function recursively returns the total nodes in the BST
-     * @param root - the root node for the tree & resulting subtrees
-     * @return an integer with the total number of nodes in the tree
-     */
-    int getCount(node *root) const {
-        // this counts the current node
-        int count = 1;
-        // If there are values in the left child node
-        if (root->leftPtr) {
-            // adds to the total # of left nodes (recursively calls function)
-            count += getCount(root->leftPtr);
-        }
-        // If the right child node is not empty
-        if (root->rightPtr) {
-            // it adds to the total # of right nodes recursively
-            count +=  getCount(root->rightPtr);
-        }
-        // Once both left and right == null and there are no more calls to make
-        // the count is returned
-        return count;
-    }
-
     /**
      * This helper function recursively counts the height of the node by
      * comparing the left and right sides and returning the larger of those two
@@ -154,12 +304,14 @@ class BST {
      *
      * @param visit - adds the root->data to the stringStream for bst_test.cpp
      * @param root - the current node
+     * @param repeat - visit data once per copy held (multiset mode)
      */
-    static void preorderHelper(void visit(const T &item), node* root) {
+    static void preorderHelper(void visit(const T &item), node* root,
+                               bool repeat) {
         if (root) {
-            visit(root->data);
-            preorderHelper(visit, root->leftPtr);
-            preorderHelper(visit, root->rightPtr);
+            visitNode(visit, root, repeat);
+            preorderHelper(visit, root->leftPtr, repeat);
+            preorderHelper(visit, root->rightPtr, repeat);
         }
     }
 
@@ -170,12 +322,14 @@ class BST {
     *
     * @param visit - adds the root->data to the stringStream for bst_test.cpp
     * @param root - the current node
+    * @param repeat - visit data once per copy held (multiset mode)
     */
-    static void inorderHelper(void visit(const T &item), node* root) {
+    static void inorderHelper(void visit(const T &item), node* root,
+                              bool repeat) {
         if (root) {
-            inorderHelper(visit, root->leftPtr);
-            visit(root->data);
-            inorderHelper(visit, root->rightPtr);
+            inorderHelper(visit, root->leftPtr, repeat);
+            visitNode(visit, root, repeat);
+            inorderHelper(visit, root->rightPtr, repeat);
         }
     }
 
@@ -186,17 +340,56 @@ class BST {
     *
     * @param visit - adds the root->data to the stringStream for bst_test.cpp
     * @param root - the current node
+    * @param repeat - visit data once per copy held (multiset mode)
     */
-    static void postorderHelper(void visit(const T &item), node* root) {
+    static void postorderHelper(void visit(const T &item), node* root,
+                                bool repeat) {
         if (root) {
             // recursively traverses left child nodes
-            postorderHelper(visit, root->leftPtr);
+            postorderHelper(visit, root->leftPtr, repeat);
             // recursively traverses right child nodes
-            postorderHelper(visit, root->rightPtr);
+            postorderHelper(visit, root->rightPtr, repeat);
             // outputs the root data
-            visit(root->data);
+            visitNode(visit, root, repeat);
+        }
+    }
+
+    /**
+     * Inorder traversal of the items in [lo, hi] only. Subtrees entirely
+     * outside the range are not entered, so this is O(height + visited).
+     * @param visit - the traversal's visit function
+     * @param root - the current node
+     * @param lo - smallest item to visit
+     * @param hi - largest item to visit
+     * @param repeat - visit data once per copy held (multiset mode)
+     */
+    static void rangeHelper(void visit(const T &item), node* root,
+                            const T &lo, const T &hi, bool repeat) {
+        if (root) {
+            if (lo < root->data)
+                rangeHelper(visit, root->leftPtr, lo, hi, repeat);
+            if (!(root->data < lo) && !(hi < root->data))
+                visitNode(visit, root, repeat);
+            if (root->data < hi)
+                rangeHelper(visit, root->rightPtr, lo, hi, repeat);
+        }
+    }
+
+    /**
+     * Visits one node for the traversal helpers. Tombstones are skipped,
+     * other nodes are visited once, or once per copy when repeating
+     * @param visit - the traversal's visit function
+     * @param n - the node being visited
+     * @param repeat - visit data once per copy held
+     */
+    static void visitNode(void visit(const T &item), const node* n,
+                          bool repeat) {
+        int times = (repeat || n->count == 0) ? n->count : 1;
+        for (int i = 0; i < times; i++) {
+            visit(n->data);
         }
     }
+
     /**
      * Visit helper function adds the root data into the stringstream for
      * assertion
@@ -217,6 +410,9 @@ class BST {
             return nullptr;
         } else {
             node* newNode = makeNode(root->data);
+            newNode->count = root->count;
+            // the hash, if nodes have one
+            static_cast<BSTNodeHash<Hashed>&>(*newNode) = *root;
             newNode->leftPtr = copyNodes(root->leftPtr);
             newNode->rightPtr = copyNodes(root->rightPtr);
             return newNode;
@@ -239,67 +435,958 @@ class BST {
             return false;
         } else {
             // return T/F if each node contains the same data
-            return ((comp1->data == comp2->data)&&areEqual(comp1->leftPtr,
+            return ((comp1->data == comp2->data) &&
+                    (comp1->count == comp2->count) && areEqual(comp1->leftPtr,
                     comp2->leftPtr) && areEqual(comp1->rightPtr,
                             comp2->rightPtr));
         }
     }
 
-// Helper functions for Rebalance() function
     /**
-     * inorderSorter function traverses the BST inorder and places values in
-     * an array. Sorts the array in ascending order. Recursively increments the
-     * index of the array
-     * @param adder  - name of my array
-     * @param n  - the node being traversed
-     * @param index - the index of the array
-     * @return - an incremental index for each element in the sorted array
+     * Called when Add() finds a node that already holds the item
+     * @param n - the node holding the item
+     * @return true if n was a tombstone and is live again, false if the
+     * item was already in the tree
      */
-    int inorderSorter(T* adder, node* n, int index) {
-        // base case return the index when you reach a leaf
-        if (!n) {
-            return index;
+    bool revive(node* n) {
+        if (n->count > 0) {
+            return false;
+        }
+        n->count = 1;
+        deadCount--;
+        liveCount++;
+        return true;
+    }
+
+    // drops extra copies in the subtree at n, one copy of each item stays
+    void collapseCounts(node* n) {
+        if (n) {
+            collapseCounts(n->leftPtr);
+            collapseCounts(n->rightPtr);
+            if (n->count > 1) n->count = 1;
+            refresh(n);
+        }
+    }
+
+// Lookup helpers shared with BSTMap, where Key can be the map's key type
+    /**
+     * Plain descent that never restructures the tree
+     * @param key - an item, or anything data can be compared with
+     * @return the live node matching key, nullptr if there is none
+     */
+    template<class Key>
+    node* findNode(const Key &key) const {
+        flush();
+        node* current = rootPtr;
+        while (current && !(current->data == key)) {
+            if (current->data > key)
+                current = current->leftPtr;
+            else
+                current = current->rightPtr;
+        }
+        return (current && current->count > 0) ? current : nullptr;
+    }
+
+    /**
+     * Single descent that returns the node matching key, or links in a new
+     * leaf holding make() where key belongs, moving the result into the
+     * new node. A tombstone matching key is revived by move-assigning
+     * make() to its data.
+     * @param key - an item, or anything data can be compared with
+     * @param make - returns the item to store, only called when inserting
+     * @param inserted - set to true if the key was not in the tree
+     * @return the node holding key
+     */
+    template<class Key, class Make>
+    node* findOrInsert(const Key &key, Make make, bool &inserted) {  // NOLINT
+        flush();
+        node** link = &rootPtr;
+        // nodes whose subtree hash changes, only tracked when hashing
+        vector<node*> path;
+        while (*link) {
+            if (hashing) path.push_back(*link);
+            if ((*link)->data == key) {
+                if (multiset && (*link)->count > 0) {
+                    // one more copy of a live item
+                    (*link)->count++;
+                    modCount++;
+                    refreshPath(path);
+                    inserted = true;
+                    return *link;
+                }
+                inserted = revive(*link);
+                if (inserted) {
+                    modCount++;
+                    (*link)->data = make();
+                    refreshPath(path);
+                    prefilterAdd((*link)->data);
+                }
+                return *link;
+            }
+            if ((*link)->data > key)
+                link = &(*link)->leftPtr;
+            else
+                link = &(*link)->rightPtr;
+        }
+        *link = makeNode(make());
+        refresh(*link);
+        refreshPath(path);
+        liveCount++;
+        modCount++;
+        prefilterAdd((*link)->data);
+        inserted = true;
+        return *link;
+    }
+
+    /**
+     * Single-descent removal behind Remove(), templated so BSTMap can remove
+     * by key alone
+     * @param item - an item, or anything data can be compared with
+     * @return true if a live item was removed
+     */
+    template<class Key>
+    bool removeKey(const Key &item) {
+        // drop a pending write; the tree may hold the item as well
+        bool wasBuffered = false;
+        auto runEnd = writeBuffer.begin() + bufferSorted;
+        auto pos = lower_bound(writeBuffer.begin(), runEnd, item);
+        if (pos != runEnd && *pos == item) {
+            writeBuffer.erase(pos);
+            bufferSorted--;
+            wasBuffered = true;
+        } else {
+            // the tail is unordered, so its last item can fill the gap
+            pos = find(runEnd, writeBuffer.end(), item);
+            if (pos != writeBuffer.end()) {
+                *pos = std::move(writeBuffer.back());
+                writeBuffer.pop_back();
+                wasBuffered = true;
+            }
+        }
+        // link is the pointer (rootPtr or a parent's child pointer) that
+        // points at the node being examined, so the root is unlinked the
+        // same way as any other node and one descent is enough
+        node** link = &rootPtr;
+        // ancestors of the target, only tracked when hashing
+        vector<node*> path;
+        while (*link && !((*link)->data == item)) {
+            if (hashing) path.push_back(*link);
+            if ((*link)->data > item)
+                link = &(*link)->leftPtr;
+            else
+                link = &(*link)->rightPtr;
+        }
+        // the item is not in the tree (or is already a tombstone)
+        if (!*link || (*link)->count == 0) {
+            if (wasBuffered) prefilterRemove(1);
+            return wasBuffered;
+        }
+        node* target = *link;
+        modCount++;
+        if (target->count > 1) {
+            // multiset: drop one copy, the node stays
+            target->count--;
+            refresh(target);
+            refreshPath(path);
+            return true;
+        }
+        liveCount--;
+        if (lazyDelete) {
+            // leave the node in place, compaction frees it later
+            target->count = 0;
+            refresh(target);
+            refreshPath(path);
+            deadCount++;
+            if (deadCount > maxDeadRatio * (liveCount + deadCount)) {
+                Compact();
+            }
+            prefilterRemove(1);
+            return true;
+        }
+        if (!target->leftPtr) {
+            // no left child: the right subtree (maybe empty) takes its place
+            *link = target->rightPtr;
+        } else if (!target->rightPtr) {
+            // only a left child: it takes the node's place
+            *link = target->leftPtr;
+        } else {
+            // two children: unlink the smallest node of the right subtree
+            // and relink it in the target's place, no data is copied
+            node** succLink = &target->rightPtr;
+            vector<node*> succPath;
+            while ((*succLink)->leftPtr) {
+                if (hashing) succPath.push_back(*succLink);
+                succLink = &(*succLink)->leftPtr;
+            }
+            node* successor = *succLink;
+            *succLink = successor->rightPtr;
+            successor->leftPtr = target->leftPtr;
+            successor->rightPtr = target->rightPtr;
+            *link = successor;
+            refreshPath(succPath);
+            refresh(successor);
+        }
+        refreshPath(path);
+        delete target;
+        prefilterRemove(1);
+        return true;
+    }
+
+// Helper functions for subtree hashing
+    // mixes value into seed, order sensitive
+    static size_t combineHash(size_t seed, size_t value) {
+        return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+
+    /**
+     * Recomputes n's hash from its own fields and its children's hashes,
+     * so children must be refreshed before their parent. Does nothing
+     * unless hashing is enabled.
+     * @param n - the node whose subtree changed
+     */
+    void refresh(node* n) const {
+        refresh(n, integral_constant<bool, Hashed>());
+    }
+
+    // refresh() for a BST<T, true>, the only place std::hash<T> is used
+    void refresh(node* n, true_type) const {
+        if (hashing) {
+            size_t h = hash<T>()(n->data);
+            h = combineHash(h, n->count);
+            h = combineHash(h, n->leftPtr ? n->leftPtr->hash : 1);
+            h = combineHash(h, n->rightPtr ? n->rightPtr->hash : 2);
+            n->hash = h;
+        }
+    }
+
+    // nodes of a plain BST<T> have no hash to refresh
+    void refresh(node*, false_type) const {}
+
+    // hash kept at n, 0 in a plain BST<T>
+    static size_t nodeHash(const node* n) {
+        return nodeHash(n, integral_constant<bool, Hashed>());
+    }
+    static size_t nodeHash(const node* n, true_type) {
+        return n->hash;
+    }
+    static size_t nodeHash(const node*, false_type) {
+        return 0;
+    }
+
+    // refreshes a root-to-node path, deepest node first
+    void refreshPath(const vector<node*> &path) const {
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            refresh(*it);
+        }
+    }
+
+    // recomputes every hash in the subtree at n, children first
+    void refreshAll(node* n) const {
+        if (n) {
+            refreshAll(n->leftPtr);
+            refreshAll(n->rightPtr);
+            refresh(n);
+        }
+    }
+
+    // appends the live items of the subtree at n to out, in order, once
+    // per copy held
+    static void collectItems(const node* n, vector<T> &out) {  // NOLINT
+        if (n) {
+            collectItems(n->leftPtr, out);
+            out.insert(out.end(), n->count, n->data);
+            collectItems(n->rightPtr, out);
+        }
+    }
+
+    /**
+     * Adds the items that are live in exactly one of two subtrees covering
+     * the same key range to out. Subtrees with equal hashes are skipped;
+     * when both roots hold the same item the two sides are compared
+     * separately, otherwise both subtrees are listed and compared in full.
+     * @param a - subtree root in this tree
+     * @param b - subtree root in the other tree
+     * @param useHash - true if both trees keep hashes
+     * @param out - collects the differing items
+     */
+    static void diffHelper(const node* a, const node* b, bool useHash,
+                           vector<T> &out) {                // NOLINT
+        if (!a && !b) {
+            return;
+        }
+        if (a && b && useHash && nodeHash(a) == nodeHash(b)) {
+            return;
+        }
+        if (a && b && a->data == b->data) {
+            // an item held a different number of times (a tombstone holds
+            // none) is listed once per extra copy
+            int extra = a->count > b->count ? a->count - b->count
+                                            : b->count - a->count;
+            out.insert(out.end(), extra, a->data);
+            diffHelper(a->leftPtr, b->leftPtr, useHash, out);
+            diffHelper(a->rightPtr, b->rightPtr, useHash, out);
+            return;
+        }
+        vector<T> aItems;
+        vector<T> bItems;
+        collectItems(a, aItems);
+        collectItems(b, bItems);
+        set_symmetric_difference(aItems.begin(), aItems.end(),
+                                 bItems.begin(), bItems.end(),
+                                 back_inserter(out));
+    }
+
+// Helper functions for buffered-write mode
+    // true if item is waiting in the write buffer
+    bool bufferHas(const T &item) const {
+        auto runEnd = writeBuffer.begin() + bufferSorted;
+        return binary_search(writeBuffer.begin(), runEnd, item) ||
+               find(runEnd, writeBuffer.end(), item) != writeBuffer.end();
+    }
+
+    // appends a new item to the buffer; an item past the end of the run
+    // extends it, anything else goes to the tail
+    void bufferAppend(const T &item) {
+        writeBuffer.push_back(item);
+        if (writeBuffer.size() == bufferSorted + 1 &&
+            (bufferSorted == 0 || writeBuffer[bufferSorted - 1] < item)) {
+            bufferSorted++;
+        } else {
+            // folding the tail in moves the whole run, so the tail may grow
+            // to the square root of the run before it is sorted in
+            size_t tail = writeBuffer.size() - bufferSorted;
+            if (tail > BUFFER_TAIL && tail * tail > bufferSorted) {
+                sortBuffer();
+            }
+        }
+    }
+
+    // sorts the unsorted tail into the run, so the whole buffer is sorted
+    void sortBuffer() const {
+        auto runEnd = writeBuffer.begin() + bufferSorted;
+        sort(runEnd, writeBuffer.end());
+        inplace_merge(writeBuffer.begin(), runEnd, writeBuffer.end());
+        bufferSorted = writeBuffer.size();
+    }
+
+    /**
+     * Merges the write buffer into the tree. Items already live in the
+     * tree are dropped, tombstones are revived.
+     * Logically const: buffered items are already part of the set.
+     */
+    void mergeBuffer() const {
+        sortBuffer();
+        modCount++;
+        // a batch that is large next to the tree would arrive as a sorted
+        // run and grow a long chain, so relink everything instead
+        if (writeBuffer.size() * 8 >= static_cast<size_t>(liveCount)) {
+            mergeRebuild();
+        } else {
+            mergeInsert();
+        }
+        writeBuffer.clear();
+        bufferSorted = 0;
+    }
+
+    /**
+     * Linear merge of the tree's nodes (in order) with the buffer, then
+     * relinks the result into a balanced tree. Tombstones are freed.
+     */
+    void mergeRebuild() const {
+        vector<node*> treeNodes;
+        treeNodes.reserve(liveCount + deadCount);
+        collectNodes(rootPtr, treeNodes);
+        vector<node*> merged;
+        merged.reserve(treeNodes.size() + writeBuffer.size());
+        size_t b = 0;
+        for (node* n : treeNodes) {
+            while (b < writeBuffer.size() && writeBuffer[b] < n->data) {
+                merged.push_back(makeNode(writeBuffer[b++]));
+                liveCount++;
+            }
+            if (b < writeBuffer.size() && writeBuffer[b] == n->data) {
+                // already in the tree: keep the node, revive a tombstone
+                b++;
+                if (n->count == 0) {
+                    n->count = 1;
+                    deadCount--;
+                    liveCount++;
+                }
+            }
+            if (n->count == 0) {
+                delete n;
+                deadCount--;
+            } else {
+                merged.push_back(n);
+            }
         }
-        // traverse down the left child
-        if (n->leftPtr) {
-            index = inorderSorter(adder, n->leftPtr, index);
+        while (b < writeBuffer.size()) {
+            merged.push_back(makeNode(writeBuffer[b++]));
+            liveCount++;
         }
-        // input the value into the array
-        adder[index] = n->data;
-        // increase the index
-        index++;
-        // traverse the right child
-        if (n->rightPtr) {
-            index = inorderSorter(adder, n->rightPtr, index);
+        rootPtr = linkBalanced(merged, 0, static_cast<int>(merged.size()) - 1);
+    }
+
+    // appends the nodes of the subtree at n to out, in order
+    static void collectNodes(node* n, vector<node*> &out) {  // NOLINT
+        if (n) {
+            collectNodes(n->leftPtr, out);
+            out.push_back(n);
+            collectNodes(n->rightPtr, out);
         }
-        // satisfies cppcheck.
-        return index;
     }
 
     /**
-     * This constructs a rebalanced BST using the inorderSorter function above
-     * It finds the middle of the array and places it as a node, then it
-     * recursively searches the left and right half of the array until the
-     * balanced BST is created
-     * @param adder - sorted array - adds elements to the BST
-     * @param start - the first index of each array (and subarray)
-     * @param end - the last index of each array (and subarray)
+     * Inserts the sorted buffer one item at a time. Consecutive keys share
+     * most of their search path, so each descent resumes from the deepest
+     * point that still bounds the next key instead of the root: the
+     * previous item's node, or the shallowest left turn the key has passed.
+     * Keys only grow, so a node left behind is never modified again and
+     * its hash is refreshed once, as it is left.
      */
-    void rebalanceBST(T* adder, int start, int end) {
-        // if end index crosses the starting index the array has been exhausted
+    void mergeInsert() const {
+        // nodes where the descents went left, shallowest first; each one's
+        // data bounds the keys that can still go below it
+        vector<node*> leftTurns;
+        // the current root-to-node path, only kept for refreshing hashes
+        vector<node*> path;
+        // node holding the previous item
+        node* last = nullptr;
+        for (const T &item : writeBuffer) {
+            // left turns not larger than item cannot hold it below them;
+            // the shallowest such one is where the new descent starts,
+            // otherwise it goes on right of the previous item
+            node* start = last;
+            while (!leftTurns.empty() && !(item < leftTurns.back()->data)) {
+                start = leftTurns.back();
+                leftTurns.pop_back();
+            }
+            if (hashing && start) {
+                // the nodes below start are done, start itself is visited
+                // again by the descent
+                while (path.back() != start) {
+                    refresh(path.back());
+                    path.pop_back();
+                }
+                path.pop_back();
+            }
+            // start is never null when it is used, so only child pointers
+            // are written through link
+            node** link = start ? &start : &rootPtr;
+            while (*link && !((*link)->data == item)) {
+                bool left = item < (*link)->data;
+                if (left) leftTurns.push_back(*link);
+                if (hashing) path.push_back(*link);
+                link = left ? &(*link)->leftPtr : &(*link)->rightPtr;
+            }
+            if (!*link) {
+                *link = makeNode(item);
+                liveCount++;
+            } else if ((*link)->count == 0) {
+                (*link)->count = 1;
+                deadCount--;
+                liveCount++;
+            }
+            // later keys are larger, so they go right of this node
+            last = *link;
+            if (hashing) path.push_back(last);
+        }
+        while (!path.empty()) {
+            refresh(path.back());
+            path.pop_back();
+        }
+    }
+
+    // merge pending writes, if any
+    void flush() const {
+        if (!writeBuffer.empty()) {
+            mergeBuffer();
+        }
+    }
+
+// Helper functions for self-adjusting (splay) mode
+    /**
+     * Top-down splay. Brings item (or the last node visited while looking for
+     * it) to the root in a single descent. Nodes smaller than item are hung
+     * off leftMax and nodes larger than item off rightMin, so no parent
+     * pointers are needed. Zig-zig steps rotate first, which is what halves
+     * the depth of the access path and keeps hot keys near the root.
+     * @param item - the value being accessed
+     */
+    void splay(const T &item) const {
+        if (!rootPtr) return;
+        // rotations move nodes between the finger's ranges, and between the
+        // subtrees an incremental rebalance has still to collect
+        finger.clear();
+        collectStale = true;
+        // roots and attachment points of the left and right assembly trees
+        node* leftTree = nullptr;
+        node* leftMax = nullptr;
+        node* rightTree = nullptr;
+        node* rightMin = nullptr;
+        // nodes linked into the left and right trees, in link order; each
+        // gets a new inner child at the next link or at reassembly
+        vector<node*> linked;
+        node* current = rootPtr;
+        while (true) {
+            if (item < current->data) {
+                if (!current->leftPtr) break;
+                // zig-zig: rotate right before linking
+                if (item < current->leftPtr->data) {
+                    node* pivot = current->leftPtr;
+                    current->leftPtr = pivot->rightPtr;
+                    pivot->rightPtr = current;
+                    // the demoted node's children are final already
+                    refresh(current);
+                    current = pivot;
+                    if (!current->leftPtr) break;
+                }
+                // link current into the right tree
+                if (rightMin)
+                    rightMin->leftPtr = current;
+                else
+                    rightTree = current;
+                rightMin = current;
+                if (hashing) linked.push_back(current);
+                current = current->leftPtr;
+            } else if (current->data < item) {
+                if (!current->rightPtr) break;
+                // zag-zag: rotate left before linking
+                if (current->rightPtr->data < item) {
+                    node* pivot = current->rightPtr;
+                    current->rightPtr = pivot->leftPtr;
+                    pivot->leftPtr = current;
+                    refresh(current);
+                    current = pivot;
+                    if (!current->rightPtr) break;
+                }
+                // link current into the left tree
+                if (leftMax)
+                    leftMax->rightPtr = current;
+                else
+                    leftTree = current;
+                leftMax = current;
+                if (hashing) linked.push_back(current);
+                current = current->rightPtr;
+            } else {
+                break;
+            }
+        }
+        // reassemble: current's subtrees go to the inner edges of the
+        // left and right trees, which then become current's children
+        if (leftMax) {
+            leftMax->rightPtr = current->leftPtr;
+            current->leftPtr = leftTree;
+        }
+        if (rightMin) {
+            rightMin->leftPtr = current->rightPtr;
+            current->rightPtr = rightTree;
+        }
+        // later links hang below earlier ones, so refresh in reverse
+        refreshPath(linked);
+        refresh(current);
+        rootPtr = current;
+    }
+
+// Helper functions for RemoveIf() and RemoveRange()
+    /**
+     * Inorder pass that deletes nodes matching pred and collects the rest
+     * @param pred - removal predicate
+     * @param n - the current node
+     * @param survivors - surviving nodes, in sorted order
+     * @param removed - incremented for each deleted node
+     */
+    template<class Predicate>
+    static void removeIfHelper(Predicate &pred, node* n,
+                               vector<node*> &survivors,    // NOLINT
+                               int &removed) {              // NOLINT
+        if (n) {
+            node* right = n->rightPtr;
+            removeIfHelper(pred, n->leftPtr, survivors, removed);
+            if (n->count == 0) {
+                // tombstones are purged on the way, but not counted
+                delete n;
+            } else if (pred(n->data)) {
+                delete n;
+                removed++;
+            } else {
+                survivors.push_back(n);
+            }
+            removeIfHelper(pred, right, survivors, removed);
+        }
+    }
+
+    /**
+     * Relinks already allocated nodes, sorted by data, into a balanced tree
+     * @param sorted - nodes in inorder
+     * @param start - first index of the subarray
+     * @param end - last index of the subarray
+     * @return the root of the balanced subtree, nullptr if range is empty
+     */
+    node* linkBalanced(const vector<node*> &sorted, int start,
+                       int end) const {
         if (start > end) {
+            return nullptr;
+        }
+        int mid = (start + end) / 2;
+        node* subRoot = sorted[mid];
+        subRoot->leftPtr = linkBalanced(sorted, start, mid - 1);
+        subRoot->rightPtr = linkBalanced(sorted, mid + 1, end);
+        refresh(subRoot);
+        return subRoot;
+    }
+
+    /**
+     * Unlinks the smallest node of the subtree at n
+     * @param n - subtree root, not null
+     * @param smallest - set to the unlinked node
+     * @return the new root of the subtree
+     */
+    node* removeMin(node* n, node*& smallest) {  // NOLINT
+        if (!n->leftPtr) {
+            smallest = n;
+            return n->rightPtr;
+        }
+        n->leftPtr = removeMin(n->leftPtr, smallest);
+        refresh(n);
+        return n;
+    }
+
+    /**
+     * Joins two subtrees where every item in left is smaller than every
+     * item in right, by lifting the smallest node of right to be the root
+     * @return root of the joined subtree
+     */
+    node* join(node* left, node* right) {
+        if (!left) return right;
+        if (!right) return left;
+        node* newRoot;
+        right = removeMin(right, newRoot);
+        newRoot->leftPtr = left;
+        newRoot->rightPtr = right;
+        refresh(newRoot);
+        return newRoot;
+    }
+
+    /**
+     * Removes every item in [lo, hi] from the subtree at n. Subtrees lying
+     * entirely outside the range are not entered; below an in-range node
+     * one side is always entirely in range, so only the topmost in-range
+     * node needs a real join.
+     * @param removed - incremented for each live node deleted
+     * @param purged - incremented for each tombstone deleted
+     * @return the new root of the subtree
+     */
+    node* removeRangeHelper(node* n, const T &lo, const T &hi,
+                            int &removed, int &purged) {  // NOLINT
+        if (!n) {
+            return nullptr;
+        }
+        if (n->data < lo) {
+            n->rightPtr = removeRangeHelper(n->rightPtr, lo, hi, removed,
+                                            purged);
+            refresh(n);
+            return n;
+        }
+        if (n->data > hi) {
+            n->leftPtr = removeRangeHelper(n->leftPtr, lo, hi, removed,
+                                           purged);
+            refresh(n);
+            return n;
+        }
+        node* left = removeRangeHelper(n->leftPtr, lo, hi, removed,
+                                           purged);
+        node* right = removeRangeHelper(n->rightPtr, lo, hi, removed,
+                                            purged);
+        if (n->count == 0)
+            purged++;
+        else
+            removed++;
+        delete n;
+        return join(left, right);
+    }
+
+// Helper functions for finger search
+    /**
+     * Moves the finger to item: climbs the remembered path until a node's
+     * range holds item, then descends from there. Nearby items share most
+     * of their path, so the climb and the descent are both short.
+     * @param item - the value being searched for
+     * @return the node holding item (maybe a tombstone), nullptr if there
+     * is none; the finger then ends at the node item would hang below
+     */
+    node* fingerFind(const T &item) const {
+        if (fingerMods != modCount) {
+            finger.clear();
+            fingerMods = modCount;
+        }
+        while (!finger.empty()) {
+            const FingerStep &step = finger.back();
+            if ((!step.lo || *step.lo < item) && (!step.hi || item < *step.hi))
+                break;
+            finger.pop_back();
+        }
+        if (finger.empty()) {
+            if (!rootPtr) return nullptr;
+            finger.push_back({rootPtr, nullptr, nullptr});
+        }
+        while (true) {
+            FingerStep step = finger.back();
+            if (step.n->data == item) {
+                return step.n;
+            }
+            FingerStep child;
+            if (item < step.n->data)
+                child = {step.n->leftPtr, step.lo, &step.n->data};
+            else
+                child = {step.n->rightPtr, &step.n->data, step.hi};
+            if (!child.n) {
+                return nullptr;
+            }
+            finger.push_back(child);
+        }
+    }
+
+    /**
+     * Add() through the finger: the new leaf hangs below where the finger
+     * search stopped, and the finger stays on it for the next call
+     * @param item - the value being added, the tree is not empty
+     * @return true if the item was added
+     */
+    bool fingerAdd(const T &item) {
+        node* found = fingerFind(item);
+        bool added = true;
+        if (found && multiset && found->count > 0) {
+            found->count++;
+        } else if (found) {
+            added = revive(found);
+        } else {
+            FingerStep parent = finger.back();
+            node* child = makeNode(item);
+            if (item < parent.n->data) {
+                parent.n->leftPtr = child;
+                finger.push_back({child, parent.lo, &parent.n->data});
+            } else {
+                parent.n->rightPtr = child;
+                finger.push_back({child, &parent.n->data, parent.hi});
+            }
+            liveCount++;
+        }
+        if (added) {
+            // the finger is the whole path from the root, deepest last
+            for (auto it = finger.rbegin(); it != finger.rend(); ++it) {
+                refresh(it->n);
+            }
+            modCount++;
+            fingerMods = modCount;
+            prefilterAdd(item);
+        }
+        return added;
+    }
+
+// Helper functions for the Contains() prefilter
+    // adds the live items of the subtree at n to the prefilter
+    void fillPrefilter(const node* n) {
+        if (n) {
+            fillPrefilter(n->leftPtr);
+            if (n->count > 0) prefilter.Insert(prefilterHash(n->data));
+            fillPrefilter(n->rightPtr);
+        }
+    }
+
+    // sizes the prefilter for twice the current items and refills it
+    void rebuildPrefilter() {
+        size_t items = liveCount + writeBuffer.size();
+        prefilter.Reset(max<size_t>(2 * items, 1024), prefilterRate);
+        fillPrefilter(rootPtr);
+        for (const T &item : writeBuffer) {
+            prefilter.Insert(prefilterHash(item));
+        }
+        prefilterStale = 0;
+    }
+
+    // records an item added, rebuilding once the filter is too full
+    void prefilterAdd(const T &item) {
+        if (prefiltering) {
+            prefilter.Insert(prefilterHash(item));
+            if (prefilter.IsOverfull()) rebuildPrefilter();
+        }
+    }
+
+    // the prefilter's hash function, std::hash<T>
+    static size_t hashItem(const T &item) {
+        return hash<T>()(item);
+    }
+
+    // records removed items, rebuilding once they outnumber live ones
+    void prefilterRemove(int removed) {
+        if (prefiltering) {
+            prefilterStale += removed;
+            if (prefilterStale > liveCount) rebuildPrefilter();
+        }
+    }
+
+// Helper functions for incremental rebalance and release
+    /**
+     * Frees up to budget nodes of the subtrees in pending, children are
+     * pushed back so no recursion is needed
+     * @return true if pending is empty
+     */
+    static bool freeNodes(vector<node*> &pending, int budget) {  // NOLINT
+        while (budget > 0 && !pending.empty()) {
+            node* n = pending.back();
+            pending.pop_back();
+            if (n->leftPtr) pending.push_back(n->leftPtr);
+            if (n->rightPtr) pending.push_back(n->rightPtr);
+            delete n;
+            budget--;
+        }
+        return pending.empty();
+    }
+
+    // leaves a detached subtree to the Reclaimer thread in background
+    // release mode, to ReclaimStep() otherwise
+    void deferNodes(node* root) {
+        if (backgroundRelease) {
+            Reclaimer::Instance().Submit([root]() {
+                vector<node*> pending{root};
+                freeNodes(pending, INT_MAX);
+            });
+        } else {
+            pendingFree.push_back(root);
+        }
+    }
+
+    // frees a detached subtree now, unless a release mode defers it
+    void releaseNodes(node* root) {
+        if (!root) {
             return;
+        }
+        if (backgroundRelease || incrementalRelease) {
+            deferNodes(root);
         } else {
-            // find the middle element
-            int mid = (start + end) / 2;
-            T item = adder[mid];
-            // item is added into the BST
-            Add(item);
-            // first half of array searched for subtree root
-            rebalanceBST(adder, start, mid - 1);
-            // second half of array searched for subtree root
-            rebalanceBST(adder, mid + 1, end);
+            destroy(root);
+        }
+    }
+
+    // starts collecting items for a rebalance from the current tree
+    void startRebuild() {
+        flush();
+        rebalancePhase = COLLECTING;
+        rebalanceMods = modCount;
+        collectStale = true;
+        // sized up front so no step pays for regrowing them
+        rebuildItems.reserve(liveCount);
+        rebuildCounts.reserve(liveCount);
+    }
+
+    // drops any rebalance in progress, a partly built copy is left to
+    // ReclaimStep()
+    void abandonRebuild() {
+        for (node* n : buildResults) {
+            if (n) deferNodes(n);
+        }
+        buildResults.clear();
+        buildFrames.clear();
+        vector<T>().swap(rebuildItems);
+        vector<int>().swap(rebuildCounts);
+        vector<node*>().swap(collectStack);
+        rebuildLast = nullptr;
+        rebalancePhase = NOT_REBALANCING;
+    }
+
+    /**
+     * Copies up to budget items (tombstones included in the budget, not in
+     * the copy) following rebuildLast. The inorder stack carries over to
+     * the next step; after a splay it is rebuilt by a descent from the
+     * root, whose nodes count against the budget too.
+     * @param budget - most nodes to visit
+     * @return nodes visited
+     */
+    int collectStep(int budget) {
+        int work = 0;
+        if (collectStale) {
+            collectStack.clear();
+            node* current = rootPtr;
+            while (current) {
+                if (!rebuildLast || rebuildLast->data < current->data) {
+                    collectStack.push_back(current);
+                    current = current->leftPtr;
+                } else {
+                    current = current->rightPtr;
+                }
+                work++;
+            }
+            collectStale = false;
         }
+        while (work < budget && !collectStack.empty()) {
+            node* n = collectStack.back();
+            collectStack.pop_back();
+            if (n->count > 0) {
+                rebuildItems.push_back(n->data);
+                rebuildCounts.push_back(n->count);
+            }
+            rebuildLast = n;
+            work++;
+            for (node* current = n->rightPtr; current;
+                 current = current->leftPtr) {
+                collectStack.push_back(current);
+            }
+        }
+        if (collectStack.empty()) {
+            rebalancePhase = BUILDING;
+            buildFrames.push_back(
+                    {0, static_cast<int>(rebuildItems.size()) - 1, false});
+        }
+        return work;
+    }
+
+    /**
+     * Creates up to budget nodes of the balanced copy, children before
+     * their parent so hashes can be computed on the way. The finished copy
+     * replaces the tree and the old nodes go to pendingFree.
+     * @param budget - most nodes to create
+     * @return nodes created
+     */
+    int buildStep(int budget) {
+        int work = 0;
+        while (work < budget && !buildFrames.empty()) {
+            BuildFrame frame = buildFrames.back();
+            buildFrames.pop_back();
+            if (frame.lo > frame.hi) {
+                buildResults.push_back(nullptr);
+                continue;
+            }
+            int mid = (frame.lo + frame.hi) / 2;
+            if (!frame.expanded) {
+                // left half ends up on top, so it is built first
+                buildFrames.push_back({frame.lo, frame.hi, true});
+                buildFrames.push_back({mid + 1, frame.hi, false});
+                buildFrames.push_back({frame.lo, mid - 1, false});
+                continue;
+            }
+            node* right = buildResults.back();
+            buildResults.pop_back();
+            node* left = buildResults.back();
+            buildResults.pop_back();
+            node* n = makeNode(rebuildItems[mid]);
+            n->count = rebuildCounts[mid];
+            n->leftPtr = left;
+            n->rightPtr = right;
+            refresh(n);
+            buildResults.push_back(n);
+            work++;
+        }
+        if (buildFrames.empty()) {
+            if (rootPtr) deferNodes(rootPtr);
+            finger.clear();
+            rootPtr = buildResults.back();
+            buildResults.clear();
+            liveCount = static_cast<int>(rebuildItems.size());
+            deadCount = 0;
+            abandonRebuild();
+        }
+        return work;
     }
 
  public:
@@ -316,6 +1403,8 @@ class BST {
     explicit BST(const T &rootItem) {
         // RootPtr becomes a new node with no children
         rootPtr = makeNode(rootItem);
+        refresh(rootPtr);
+        liveCount = 1;
     }
 
     // given an array of length n
@@ -335,9 +1424,27 @@ class BST {
      * @param bst - the BST being copied
      */
     // copy constructor
-    explicit BST(const BST<T> &bst) {
+    explicit BST(const BST &bst) {
         // TODO(Jenna)
+        bst.flush();
         this->rootPtr = copyNodes(bst.rootPtr);
+        bufferCapacity = bst.bufferCapacity;
+        hashing = bst.hashing;
+        multiset = bst.multiset;
+        incrementalRelease = bst.incrementalRelease;
+        backgroundRelease = bst.backgroundRelease;
+        prefiltering = bst.prefiltering;
+        prefilter = bst.prefilter;
+        prefilterRate = bst.prefilterRate;
+        prefilterStale = bst.prefilterStale;
+        prefilterHash = bst.prefilterHash;
+        fingerSearch = bst.fingerSearch;
+        selfAdjusting = bst.selfAdjusting;
+        splayMinDepth = bst.splayMinDepth;
+        liveCount = bst.liveCount;
+        deadCount = bst.deadCount;
+        lazyDelete = bst.lazyDelete;
+        maxDeadRatio = bst.maxDeadRatio;
     }
 
     /**
@@ -347,6 +1454,16 @@ class BST {
         // TODO(Jenna)
         Clear();
         delete rootPtr;
+        // nodes deferred to ReclaimStep() cannot outlive the tree, in
+        // background release mode they go to the background thread
+        abandonRebuild();
+        if (backgroundRelease) {
+            for (node* n : pendingFree) {
+                deferNodes(n);
+            }
+            pendingFree.clear();
+        }
+        freeNodes(pendingFree, INT_MAX);
     }
     /*************************************/
     //          Functions                //
@@ -354,16 +1471,19 @@ class BST {
     // true if no nodes in BST
     bool IsEmpty() const {
         // TODO(Jenna)
-        // if the root is null it's empty
-        return rootPtr == nullptr;
+        // empty if no live nodes and nothing is buffered; tombstones left by
+        // lazy delete may still hang off the root
+        return liveCount == 0 && writeBuffer.empty();
     }
 
     // 0 if empty, 1 if only root, otherwise
     // height of root is max height of subtrees + 1
     int getHeight() const {
         // TODO(Jenna)
-        // if empty return height = 0
-        if (this->IsEmpty()) {
+        // buffered items count towards the height
+        flush();
+        // if no nodes (live or tombstoned) return height = 0
+        if (rootPtr == nullptr) {
             return 0;
         } else {
             // pointer node for rootPtr created
@@ -373,217 +1493,162 @@ class BST {
         }
     }
 
-    // number of nodes in BST
+    // number of items in BST, kept up to date by every modifying function
+    // so no scan is needed (tombstoned nodes are not counted). Pending
+    // writes are merged first, since some may be duplicates
     int NumberOfNodes() const {
-        // TODO(Jenna)
-        // if its empty, there are no nodes
-        if (IsEmpty()) {
-            return 0;
-        }
-        // if the root has no children, return 1
-        if (isLeaf(rootPtr)) {
-            return 1;
-        } else {
-            // start the counter at 0
-            int count = 0;
-            // uses recursive helper function to count all of the nodes
-            count = getCount(rootPtr);
-            // returns the total number of nodes
-            return count;
-        }
+        flush();
+        return liveCount;
     }
 
     // add a new item, return true if successful
     bool Add(const T &item) {
-        // if the tree is empty
-        // TODO(Jenna)
-        // make a new child leaf node of the item
-        node *child = makeNode(item);
-        if (IsEmpty()) {
-            // the child node becomes the root node
-            rootPtr = child;
-            // insertion was successful, return true
-            return true;
-        } else {
-            // prevents duplication and memory leaks :)
-            if (this->Contains(item)) {
-                // new node removed
-                delete child;
-                // new node dereferenced
-                child = nullptr;
-                // duplicate node not added
+        if (bufferCapacity > 0 && !multiset) {
+            // buffered: no tree descent, only items already waiting in the
+            // buffer are reported as duplicates here
+            if (bufferHas(item)) {
                 return false;
             }
-            // currentRoot is initialized at the root of the tree
-            node *currentRoot = rootPtr;
-            // initialize child's parent(root) node;
-            node *parent;
-            // while currentRoot isn't empty
-            while (currentRoot) {
-                // as we traverse down the tree, this keeps track of the root
-                // for the newly added node
-                parent = currentRoot;
-                // if the child's data is greater than the current root's data
-                // traverse down the right child nodes
-                if (child->data > currentRoot->data)
-                    currentRoot = currentRoot->rightPtr;
-                    // Otherwise, traverse down the left child nodes
-                else
-                    currentRoot = currentRoot->leftPtr;
+            bufferAppend(item);
+            prefilterAdd(item);
+            if (static_cast<int>(writeBuffer.size()) >= bufferCapacity) {
+                mergeBuffer();
             }
-            // if the new node's data is less than it's root's data
-            if (child->data < parent->data)
-                // make the newly added node the left child of that root
-                parent->leftPtr = child;
-                // otherwise add it to the root's right child node
-            else
-                parent->rightPtr = child;
-            // node has been added - return true
             return true;
         }
-    }
-
-    // remove item, return true if successful
-    bool Remove(const T &item) const {
-        // TODO(Jenna)
-        // if the tree is empty, return false
-        if (IsEmpty()) {
-            return false;
-        }
-        // if the item is not in the tree, return false
-        if (!(Contains(item))) {
-            return false;
-        } else {
-            // otherwise create a node starting at the root
-            node* child = rootPtr;
-            // create a second node to keep track of the target's root
-            node* parent = child;
-            // while the current node is not empty locate the node being removed
-            while (child) {
-                // if target is found, break out of the loop
-                if (child->data == item) {
-                    break;
-                } else {
-                    // parent node = child, child node traverses down the tree
-                    parent = child;
-                    // if the child's data is greater than the item, look left
-                    if (child->data > item)
-                        child = child->leftPtr;
-                        // otherwise traverse through the right child nodes
-                    else
-                        child = child->rightPtr;
-                }
-            }
-            if (parent != nullptr && child != nullptr) {
-                // If the node has no children, simply remove the node
-                if (isLeaf(child)) {
-                    // if the child was a left child of the parent node, set
-                    // it to null
-                    if (parent->leftPtr == child) parent->leftPtr = nullptr;
-                        // Otherwise, remove the right child
-                    if (parent->rightPtr == child) parent->rightPtr = nullptr;
-                    // delete the child node
-                    delete child;
-                    // derefence the node
-                    child = nullptr;
-                    // return true
-                    return true;
-                }
-                // If the node has 1 child, replace the root with the child node
-                // right child present, no left child
-                if (!child->leftPtr && child->rightPtr) {
-                    // If the node being removed was a left child node
-                    if (parent->leftPtr == child) {
-                        // set the parent's left child to the child's right node
-                        parent->leftPtr = child->rightPtr;
-                        // remove the node
-                        delete child;
-                        child = nullptr;
-                    } else {    // if the node being removed was a right child
-                        // node set parent's right node to child's right node
-                        parent->rightPtr = child->rightPtr;
-                        // remove the node
-                        delete child;
-                        child = nullptr;
-                    }
-                    // return true
-                    return true;
-                } else if (child->leftPtr && !child->rightPtr) {
-                    // if the node being removed was the parent's left child
-                    if (parent->leftPtr == child) {
-                        // set the parent's left child to the child's left node
-                        parent->leftPtr = child->leftPtr;
-                        // remove node
-                        delete child;
-                        child = nullptr;
-                    } else {  // Otherwise, it's the parent's right child
-                        // parent's right child is set to the child's left node
-                        parent->rightPtr = child->leftPtr;
-                        // remove node
-                        delete child;
-                        child = nullptr;
-                    }
-                    // Node removed
+        // if the tree is empty
+        if (!rootPtr) {
+            // a new node becomes the root node
+            rootPtr = makeNode(item);
+            refresh(rootPtr);
+            liveCount++;
+            modCount++;
+            prefilterAdd(item);
+            // insertion was successful, return true
+            return true;
+        } else if (selfAdjusting) {
+            // bring item (or its neighbour) to the root, then split there
+            splay(item);
+            if (rootPtr->data == item) {
+                if (multiset && rootPtr->count > 0) {
+                    rootPtr->count++;
+                    refresh(rootPtr);
+                    modCount++;
                     return true;
                 }
-                // If the node has 2 children, replace with smallest descendant
-                // of right
-                if (!isLeaf(child)) {
-                    // node created to locate the smallest descendant
-                    node *currentSmallest = child->rightPtr;
-                    // if the right child is a leaf
-                    if (isLeaf(currentSmallest)) {
-                        // replace the node with the data from the right child
-                        child->data = currentSmallest->data;
-                        // delete the currentSmallest node
-                        delete currentSmallest;
-                        currentSmallest = nullptr;
-                        // set the child's right child to null
-                        child->rightPtr = nullptr;
-                    } else {  // traverse until smallest descendant located
-                        // if the right child has a left child
-                        if (child->rightPtr->leftPtr) {
-                            // set the smallestChild node to that
-                            node *smallestChild = child->rightPtr->leftPtr;
-                            // node created for smallest Child's parent (root)
-                            // node
-                            node *smallestParent = child->rightPtr;
-                            // while the smallestChild has a left child,
-                            // traverse
-                            while (smallestChild->leftPtr) {
-                                // smallest parent node becomes smallest
-                                // child node
-                                smallestParent = smallestChild;
-                                // smallest Child node traverses left
-                                smallestChild = smallestChild->leftPtr;
-                            }
-                            // data is replaced with the smallest descendant's
-                            // data
-                            child->data = smallestChild->data;
-                            // smallestChild node is deleted
-                            delete smallestChild;
-                            smallestChild = nullptr;
-                            // smallest parent node's left pointer is set to
-                            // null
-                            smallestParent->leftPtr = nullptr;
-                        } else {  // The node is replaced with the right child
-                            child->data = child->rightPtr->data;
-                            child->rightPtr = child->rightPtr->rightPtr;
-                        }
-                    }
+                bool revived = revive(rootPtr);
+                refresh(rootPtr);
+                if (revived) {
+                    modCount++;
+                    prefilterAdd(item);
                 }
+                return revived;
+            }
+            node *child = makeNode(item);
+            if (item < rootPtr->data) {
+                child->leftPtr = rootPtr->leftPtr;
+                child->rightPtr = rootPtr;
+                rootPtr->leftPtr = nullptr;
+            } else {
+                child->rightPtr = rootPtr->rightPtr;
+                child->leftPtr = rootPtr;
+                rootPtr->rightPtr = nullptr;
             }
-            // removal was successful, return true;
+            refresh(rootPtr);
+            refresh(child);
+            rootPtr = child;
+            liveCount++;
+            modCount++;
+            prefilterAdd(item);
             return true;
+        } else if (fingerSearch) {
+            // start from where the last search ended
+            return fingerAdd(item);
+        } else {
+            // one descent finds either the item (a duplicate or a tombstone)
+            // or the empty child pointer where it belongs
+            bool inserted;
+            findOrInsert(item, [&item]() { return item; }, inserted);
+            return inserted;
         }
     }
 
+    // remove item, return true if successful
+    bool Remove(const T &item) {
+        return removeKey(item);
+    }
+
+    // remove every item for which pred(item) is true, in one inorder pass.
+    // The survivors are relinked (not copied) into a balanced tree.
+    // Returns the number of items removed
+    template<class Predicate>
+    int RemoveIf(Predicate pred) {
+        flush();
+        modCount++;
+        vector<node*> survivors;
+        int removed = 0;
+        removeIfHelper(pred, rootPtr, survivors, removed);
+        rootPtr = linkBalanced(survivors, 0,
+                               static_cast<int>(survivors.size()) - 1);
+        liveCount -= removed;
+        deadCount = 0;
+        // the pass was O(n) already
+        if (prefiltering) rebuildPrefilter();
+        return removed;
+    }
+
+    // remove every item in [lo, hi], visiting only the removed nodes and
+    // the paths to the two range ends: O(height + removed).
+    // Returns the number of items removed
+    int RemoveRange(const T &lo, const T &hi) {
+        int removed = 0;
+        int purged = 0;
+        flush();
+        modCount++;
+        if (!(hi < lo)) {
+            rootPtr = removeRangeHelper(rootPtr, lo, hi, removed, purged);
+        }
+        liveCount -= removed;
+        deadCount -= purged;
+        prefilterRemove(removed);
+        return removed;
+    }
+
     // true if item is in BST
     bool Contains(const T &item) const {
         // TODO(Jenna)
+        // pending writes are checked first, the buffer is small and
+        // mostly sorted
+        if (!writeBuffer.empty() && bufferHas(item)) {
+            return true;
+        }
+        // a filter miss means the item was never added
+        if (prefiltering && !prefilter.MayContain(prefilterHash(item))) {
+            return false;
+        }
         // if the tree is empty, return false
-        if (IsEmpty()) {
+        if (!rootPtr) {
             return false;
+        } else if (selfAdjusting) {
+            // only deep accesses pay for restructuring, shallow keys are
+            // already cheap and rotating them would just churn the top.
+            // Once the walk passes splayMinDepth it is handed to splay(),
+            // which redoes the descent from the root while rotating, so no
+            // path is walked twice in full
+            int depth = 0;
+            node *child = rootPtr;
+            while (child && !(child->data == item)) {
+                if (++depth > splayMinDepth) {
+                    splay(item);
+                    return rootPtr->data == item && rootPtr->count > 0;
+                }
+                child = (child->data > item) ? child->leftPtr : child->rightPtr;
+            }
+            return child && child->count > 0;
+        } else if (fingerSearch) {
+            // start from where the last search ended
+            node *found = fingerFind(item);
+            return found && found->count > 0;
         } else {  // otherwise search through tree for value
             // child node created and set to the root
             node *child = rootPtr;
@@ -591,7 +1656,7 @@ class BST {
             while (child) {
                 // if the current node is the item, return true
                 if (child->data == item) {
-                    return true;
+                    return child->count > 0;
                 } else {  // otherwise keep looking based on comparison
                     // if the current node's data is greater than the item,
                     // look left
@@ -609,51 +1674,332 @@ class BST {
 
     // inorder traversal: left-root-right
     // takes a function that takes a single parameter of type T
-    void InorderTraverse(void visit(const T &item)) const {
+    // with repeat, an item held several times (multiset mode) is visited
+    // once per copy, the same goes for the other traversals
+    void InorderTraverse(void visit(const T &item),
+                         bool repeat = false) const {
         // TODO(Jenna)
         // calls helper function to traverse the nodes
-        inorderHelper(visit, rootPtr);
+        flush();
+        inorderHelper(visit, rootPtr, repeat);
     }
 
     // preorder traversal: root-left-right
-    void PreorderTraverse(void visit(const T &item)) const {
+    void PreorderTraverse(void visit(const T &item),
+                          bool repeat = false) const {
         // TODO(Jenna)
         // calls helper function to traverse the nodes
-        preorderHelper(visit, rootPtr);
+        flush();
+        preorderHelper(visit, rootPtr, repeat);
     }
 
     // postorder traversal: left-right-root
-    void PostorderTraverse(void visit(const T &item)) const {
+    void PostorderTraverse(void visit(const T &item),
+                           bool repeat = false) const {
         // TODO(Jenna)
         // calls helper function to traverse the nodes
-        postorderHelper(visit, rootPtr);
+        flush();
+        postorderHelper(visit, rootPtr, repeat);
     }
 
-    // create dynamic array, copy all the items to the array
-    // and then read the array to re-create this tree from scratch
-    // so that resulting tree should be balanced
+    // inorder traversal of the items in [lo, hi] only, skipping the
+    // subtrees that lie outside the range
+    void RangeTraverse(const T &lo, const T &hi, void visit(const T &item),
+                       bool repeat = false) const {
+        flush();
+        rangeHelper(visit, rootPtr, lo, hi, repeat);
+    }
+
+    // relink the existing nodes into a tree of minimum height. No items
+    // are copied, so per-node counts carry over, and tombstones are freed
     void Rebalance() {
         // TODO(me)
-        int size = NumberOfNodes();
-        T* sortedArray = new T[size];
-        inorderSorter(sortedArray, rootPtr, 0);
-        Clear();
-        rebalanceBST(sortedArray, 0, size - 1);
-        delete[] sortedArray;
-        sortedArray = nullptr;
+        // RemoveIf merges any pending writes first
+        RemoveIf([](const T &) { return false; });
+    }
+
+    // start an incremental rebalance, driven by RebalanceStep(). The tree
+    // stays as it is, and fully usable, until the balanced copy is done
+    void StartRebalance() {
+        abandonRebuild();
+        startRebuild();
+    }
+
+    // do at most budget nodes' worth of rebalance work: copying items out,
+    // building the balanced copy, then freeing the old nodes once the copy
+    // has been swapped in. A change to the items between steps restarts
+    // the copy from scratch. Returns true once nothing is left to do
+    bool RebalanceStep(int budget) {
+        if (rebalancePhase != NOT_REBALANCING && modCount != rebalanceMods) {
+            abandonRebuild();
+            startRebuild();
+        }
+        if (rebalancePhase == COLLECTING) {
+            budget -= collectStep(budget);
+        }
+        if (rebalancePhase == BUILDING) {
+            budget -= buildStep(budget);
+        }
+        if (rebalancePhase != NOT_REBALANCING) {
+            return false;
+        }
+        return ReclaimStep(budget);
+    }
+
+    // true while an incremental rebalance has not swapped in its copy
+    bool IsRebalancing() const {
+        return rebalancePhase != NOT_REBALANCING;
+    }
+
+    // incremental release mode: Clear() and operator= detach the old nodes
+    // in O(1) and ReclaimStep() (or RebalanceStep()) frees them later. The
+    // destructor still frees everything left over
+    void SetIncrementalRelease(bool enable) {
+        incrementalRelease = enable;
+    }
+
+    // true if Clear() and operator= defer freeing the old nodes
+    bool IsIncrementalRelease() const {
+        return incrementalRelease;
+    }
+
+    // free at most budget detached nodes, return true if none are left
+    bool ReclaimStep(int budget) {
+        return freeNodes(pendingFree, budget);
+    }
+
+    // background release mode: Clear(), operator= and the destructor
+    // detach the old nodes in O(1) and a background thread frees them,
+    // as do incremental rebalances. Takes precedence over incremental
+    // release. T's destructor then runs on that thread
+    void SetBackgroundRelease(bool enable) {
+        backgroundRelease = enable;
+    }
+
+    // true if detached nodes are freed on a background thread
+    bool IsBackgroundRelease() const {
+        return backgroundRelease;
+    }
+
+    // wait until the background thread has freed everything handed to it
+    // so far, by any tree; call before shutdown
+    static void DrainBackgroundRelease() {
+        Reclaimer::Instance().Drain();
+    }
+
+    // prefilter mode: Contains() first checks a blocked Bloom filter of
+    // the added items (hashed with std::hash<T>), so most misses cost one
+    // filter block instead of a full descent. fpRate is the target share
+    // of misses that still descend, clamped to the range the filter
+    // supports. The filter is rebuilt when it fills up, when removed items
+    // outnumber live ones, and by RemoveIf(), Rebalance() and Clear()
+    void SetPrefilter(bool enable, double fpRate = 0.01) {
+        prefiltering = enable;
+        prefilterRate = BlockedBloomFilter::ClampRate(fpRate);
+        if (enable) {
+            prefilterHash = &BST::hashItem;
+            rebuildPrefilter();
+        } else {
+            prefilter = BlockedBloomFilter();
+        }
+    }
+
+    // finger search mode: Contains() and Add() start from the path of the
+    // previous search, climbing only until the item is within a node's
+    // range, so runs of nearby items cost O(log d) on average for a rank
+    // distance of d instead of O(log n). Changes other than Add() reset the
+    // finger to the root. Self-adjusting mode takes precedence
+    void SetFingerSearch(bool enable) {
+        fingerSearch = enable;
+        finger.clear();
+    }
+
+    // true if Contains() and Add() search from the finger
+    bool IsFingerSearch() const {
+        return fingerSearch;
+    }
+
+    // true if Contains() checks the Bloom filter first
+    bool IsPrefilter() const {
+        return prefiltering;
+    }
+
+    // estimated false positive rate of the prefilter right now, counting
+    // removed items still set in it; 0 when the mode is off
+    double PrefilterFalsePositiveRate() const {
+        return prefiltering ? prefilter.FalsePositiveRate() : 0;
+    }
+
+    // self-adjusting mode: Contains() and Add() splay the accessed key to
+    // the root, so a small set of hot keys stays within a few levels of it.
+    // With minDepth > 0 (semi-splay), Contains() leaves keys found at depth
+    // minDepth or shallower where they are, which avoids rewriting the top
+    // of the tree on every hit
+    void SetSelfAdjusting(bool enable, int minDepth = 0) {
+        selfAdjusting = enable;
+        splayMinDepth = minDepth;
+    }
+
+    // true if Contains() and Add() splay accessed keys
+    bool IsSelfAdjusting() const {
+        return selfAdjusting;
+    }
+
+    // buffered-write mode: with capacity > 0, Add() appends to a buffer
+    // instead of the tree (a sorted run and a short unsorted tail), and the
+    // buffer is merged into the tree in one sorted pass when it fills up. Contains() checks both.
+    // Add() only reports duplicates of other buffered items, ones already
+    // in the tree are dropped when merged. Capacity 0 merges and turns the
+    // mode off
+    void SetWriteBuffer(int capacity) {
+        bufferCapacity = capacity;
+        if (capacity <= 0) {
+            flush();
+        }
+    }
+
+    // number of added items still waiting in the write buffer
+    int NumberOfBuffered() const {
+        return static_cast<int>(writeBuffer.size());
+    }
+
+    // merge the write buffer into the tree now
+    void Flush() {
+        flush();
+    }
+
+    // lazy-delete mode: Remove() only marks the node as a tombstone, which
+    // Contains() and the traversals skip. Once tombstones make up more than
+    // maxDeadRatio of all nodes, the live nodes are compacted into a
+    // balanced tree. Turning the mode off compacts straight away.
+    // maxDeadRatio is clamped to [0, MAX_DEAD_RATIO], so a tree whose nodes
+    // are all tombstones is always compacted
+    void SetLazyDelete(bool enable, double maxDeadRatio = 0.25) {
+        lazyDelete = enable;
+        if (!(maxDeadRatio >= 0)) {
+            maxDeadRatio = 0;
+        }
+        if (maxDeadRatio > MAX_DEAD_RATIO) {
+            maxDeadRatio = MAX_DEAD_RATIO;
+        }
+        this->maxDeadRatio = maxDeadRatio;
+        if (!enable && deadCount > 0) {
+            Compact();
+        }
+    }
+
+    // true if Remove() leaves tombstones
+    bool IsLazyDelete() const {
+        return lazyDelete;
+    }
+
+    // number of tombstoned nodes waiting for compaction
+    int NumberOfTombstones() const {
+        return deadCount;
+    }
+
+    // subtree hashing: every node keeps a hash of its data, copy count
+    // and both subtrees, maintained along the modified paths. operator==
+    // then compares root hashes and Diff() skips identical subtrees.
+    // Enabling hashes the whole tree once. Only a BST<T, true> has room
+    // for the hashes (and needs std::hash<T>); it starts with them on
+    void SetHashing(bool enable) {
+        static_assert(Hashed, "subtree hashing needs a BST<T, true>");
+        if (enable && !hashing) {
+            hashing = true;
+            // a copy being built by RebalanceStep() has no hashes yet
+            modCount++;
+            flush();
+            refreshAll(rootPtr);
+        }
+        hashing = enable;
+    }
+
+    // true if subtree hashes are maintained
+    bool IsHashing() const {
+        return hashing;
+    }
+
+    // hash of the whole tree, 0 if empty or hashing is off
+    size_t RootHash() const {
+        flush();
+        return (hashing && rootPtr) ? nodeHash(rootPtr) : 0;
+    }
+
+    // items that are in exactly one of this tree and other, sorted. With
+    // hashing on in both trees, only subtrees whose hashes differ are
+    // visited, so the cost follows the size of the difference when the
+    // trees have the same shape
+    vector<T> Diff(const BST &other) const {
+        flush();
+        other.flush();
+        vector<T> differences;
+        diffHelper(rootPtr, other.rootPtr, hashing && other.hashing,
+                   differences);
+        sort(differences.begin(), differences.end());
+        return differences;
+    }
+
+    // multiset mode: Add() of an item already in the tree adds a copy to
+    // its node's count, and Remove() takes one copy away, unlinking the
+    // node when the last one goes. NumberOfNodes() still counts distinct
+    // items. The write buffer is bypassed while this is on. Turning the
+    // mode off keeps one copy of each item
+    void SetMultiset(bool enable) {
+        flush();
+        if (multiset && !enable) {
+            collapseCounts(rootPtr);
+            modCount++;
+        }
+        multiset = enable;
+    }
+
+    // true if Add() counts duplicates
+    bool IsMultiset() const {
+        return multiset;
+    }
+
+    // number of copies of item held, 0 if it is not in the tree
+    int Count(const T &item) const {
+        const node* n = findNode(item);
+        return n ? n->count : 0;
+    }
+
+    // free all tombstones and relink the live nodes into a balanced tree
+    void Compact() {
+        RemoveIf([](const T &) { return false; });
     }
 
     // delete all nodes in tree
     void Clear() {
         // TODO(Jenna)
-        // calls helper function to destroy the nodes
-        destroy(rootPtr);
+        // calls helper function to destroy the nodes, or hands them off
+        // in incremental or background release mode
+        releaseNodes(rootPtr);
+        rootPtr = nullptr;
+        modCount++;
+        writeBuffer.clear();
+        bufferSorted = 0;
+        liveCount = 0;
+        deadCount = 0;
+        if (prefiltering) rebuildPrefilter();
     }
 
     // trees are equal if they have the same structure
     // AND the same item values at all the nodes
-    bool operator==(const BST<T> &other) const {
+    // When both trees keep subtree hashes this is O(1): equal root hashes
+    // are taken as equal trees (a false match needs a 64-bit collision)
+    bool operator==(const BST &other) const {
         // TODO(Jenna)
+        if (hashing && other.hashing) {
+            flush();
+            other.flush();
+            if (liveCount != other.liveCount || deadCount != other.deadCount)
+                return false;
+            if (!rootPtr || !other.rootPtr)
+                return rootPtr == other.rootPtr;
+            return nodeHash(rootPtr) == nodeHash(other.rootPtr);
+        }
         // if they are different heights return false
         if (this->getHeight() != other.getHeight()) return false;
         // if they have a different number of nodes, return false
@@ -663,7 +2009,7 @@ class BST {
     }
 
     // not == to each other
-    bool operator!=(const BST<T> &other) const {
+    bool operator!=(const BST &other) const {
         // TODO(Jenna)
         // checks to see if they are equal and returns the negation
         return !(operator==(other));
@@ -673,12 +2019,19 @@ class BST {
      * IDE's cppcheck complains that there is no = operator, implemented so
      * it would stop complaining :)
      */
-    BST<T>& operator=(const BST<T> &that) {
+    BST& operator=(const BST &that) {
         // avoid self-copy
-        if (this != &that) {  // if the binary tree is not empty,
-            if (rootPtr != NULL)
-                // destroy the binary tree
-                destroy(rootPtr);
+        if (this != &that) {
+            that.flush();
+            writeBuffer.clear();
+            bufferSorted = 0;
+            bufferCapacity = that.bufferCapacity;
+            hashing = that.hashing;
+            multiset = that.multiset;
+            modCount++;
+            // destroy the binary tree, or hand it off in incremental or
+            // background release mode
+            releaseNodes(rootPtr);
             // that is empty
             if (that.rootPtr == NULL)
                 // this is empty
@@ -686,6 +2039,19 @@ class BST {
             // otherwise copy each node into the tree
             else
                this->rootPtr = copyNodes(that.rootPtr);
+            selfAdjusting = that.selfAdjusting;
+            splayMinDepth = that.splayMinDepth;
+            liveCount = that.liveCount;
+            deadCount = that.deadCount;
+            lazyDelete = that.lazyDelete;
+            maxDeadRatio = that.maxDeadRatio;
+            // the release modes stay, they are about this tree's memory
+            prefiltering = that.prefiltering;
+            prefilter = that.prefilter;
+            prefilterRate = that.prefilterRate;
+            prefilterStale = that.prefilterStale;
+            prefilterHash = that.prefilterHash;
+            fingerSearch = that.fingerSearch;
         }
         // return the newly copied tree
         return *this;
@@ -0,0 +1,397 @@
+/**
+ * Benchmarks for BST - Binary Search Tree
+ *
+ * Not part of the test run, build the bst_bench target and run it by hand.
+ * Timings are wall clock, so run on an otherwise idle machine.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bst.hpp"
+#include "compact_bst.hpp"
+#include "sharded_bst.hpp"
+
+using namespace std;
+
+/**
+ * Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^s,
+ * by binary searching a precomputed cumulative distribution.
+ */
+class ZipfGenerator {
+ public:
+    ZipfGenerator(int n, double s) : cdf(n) {
+        double sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += 1.0 / pow(i + 1, s);
+            cdf[i] = sum;
+        }
+        for (int i = 0; i < n; i++) {
+            cdf[i] /= sum;
+        }
+    }
+
+    int operator()(mt19937 &rng) {
+        double u = uniform(rng);
+        return lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+
+ private:
+    vector<double> cdf;
+    uniform_real_distribution<double> uniform{0.0, 1.0};
+};
+
+/**
+ * Runs every lookup in the trace against tree and prints ns per lookup
+ * @param name - label for the output line
+ * @param tree - the tree being measured
+ * @param trace - keys to look up, in order
+ */
+void timeLookups(const string &name, const BST<int> &tree,
+                 const vector<int> &trace) {
+    auto start = chrono::steady_clock::now();
+    int hits = 0;
+    for (int key : trace) {
+        hits += tree.Contains(key);
+    }
+    auto stop = chrono::steady_clock::now();
+    double ns = chrono::duration<double, nano>(stop - start).count();
+    cout << name << ": " << ns / trace.size() << " ns/lookup, height "
+         << tree.getHeight() << ", hits " << hits << endl;
+}
+
+/**
+ * Zipfian lookup trace against a plain tree (keys added in random order),
+ * a balanced tree (the same tree after Rebalance) and self-adjusting trees.
+ * With exponent 1.1 the hottest 1% of keys get roughly 3/4 of the lookups.
+ * Ranks are mapped to shuffled keys so hot keys are scattered through the
+ * tree rather than clustered at one end.
+ */
+void benchZipfLookups(double exponent) {
+    const int numKeys = 200000;
+    const int numLookups = 2000000;
+    mt19937 rng(343);
+
+    vector<int> keys(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = i * 2;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+
+    ZipfGenerator zipf(numKeys, exponent);
+    vector<int> trace(numLookups);
+    for (int i = 0; i < numLookups; i++) {
+        trace[i] = keys[zipf(rng)];
+    }
+
+    // insert in an order unrelated to hotness, otherwise the hottest keys
+    // would be the first ones added and land at the top of the plain tree
+    vector<int> insertOrder(keys);
+    shuffle(insertOrder.begin(), insertOrder.end(), rng);
+    BST<int> plain;
+    for (int key : insertOrder) {
+        plain.Add(key);
+    }
+    BST<int> balanced(plain);
+    balanced.Rebalance();
+    // self-adjusting trees start from the balanced layout
+    BST<int> splayed(balanced);
+    splayed.SetSelfAdjusting(true);
+    BST<int> semiSplayed(balanced);
+    semiSplayed.SetSelfAdjusting(true, 12);
+
+    cout << "Zipf(" << exponent << ") lookups, " << numKeys << " keys, "
+         << numLookups << " lookups" << endl;
+    timeLookups("  plain       ", plain, trace);
+    timeLookups("  balanced    ", balanced, trace);
+    timeLookups("  splay       ", splayed, trace);
+    timeLookups("  splay(d>12) ", semiSplayed, trace);
+}
+
+/**
+ * Uniform random lookups in balanced BST<int> and CompactBST<int> trees
+ * holding the same keys. CompactBST also reports its node storage, the
+ * pointer tree uses 24 bytes per node before allocator overhead (32 for a
+ * BST<int, true>, which also keeps a subtree hash).
+ */
+void benchCompactLookups() {
+    const int numKeys = 1000000;
+    const int numLookups = 2000000;
+    mt19937 rng(343);
+
+    vector<int> keys(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = i * 2;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    BST<int> pointerTree(keys.data(), numKeys);
+    CompactBST<int> compactTree(keys.data(), numKeys);
+
+    uniform_int_distribution<int> pick(0, numKeys * 2);
+    vector<int> trace(numLookups);
+    for (int i = 0; i < numLookups; i++) {
+        trace[i] = pick(rng);
+    }
+
+    cout << "Uniform lookups, " << numKeys << " keys, " << numLookups
+         << " lookups" << endl;
+    int pointerHits = 0;
+    int compactHits = 0;
+    auto start = chrono::steady_clock::now();
+    for (int key : trace) {
+        pointerHits += pointerTree.Contains(key);
+    }
+    auto mid = chrono::steady_clock::now();
+    for (int key : trace) {
+        compactHits += compactTree.Contains(key);
+    }
+    auto stop = chrono::steady_clock::now();
+    cout << "  BST        : "
+         << chrono::duration<double, nano>(mid - start).count() / numLookups
+         << " ns/lookup, hits " << pointerHits << endl;
+    cout << "  CompactBST : "
+         << chrono::duration<double, nano>(stop - mid).count() / numLookups
+         << " ns/lookup, "
+         << static_cast<double>(compactTree.MemoryUsage()) / numKeys
+         << " bytes/key, hits " << compactHits << endl;
+}
+
+/**
+ * Inserts a burst of random keys with plain Add and with buffered writes
+ * of a few buffer sizes
+ */
+void benchBufferedInserts() {
+    const int numKeys = 1000000;
+    mt19937 rng(343);
+    vector<int> keys(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = i;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+
+    // the first tree built gets fresh, sequential memory from the
+    // allocator and later ones reuse its freed nodes, so build and drop one
+    // first to give every row the same start
+    {
+        BST<int> warmUp;
+        for (int key : keys) {
+            warmUp.Add(key);
+        }
+    }
+
+    cout << "Random inserts, " << numKeys << " keys" << endl;
+    for (int capacity : {0, 1024, 4096, 16384, 65536}) {
+        BST<int> tree;
+        tree.SetWriteBuffer(capacity);
+        auto start = chrono::steady_clock::now();
+        for (int key : keys) {
+            tree.Add(key);
+        }
+        tree.Flush();
+        auto stop = chrono::steady_clock::now();
+        cout << "  buffer " << capacity << ": "
+             << chrono::duration<double, nano>(stop - start).count() / numKeys
+             << " ns/insert, nodes " << tree.NumberOfNodes() << endl;
+    }
+}
+
+/**
+ * Longest single pause of a full Rebalance against the longest
+ * RebalanceStep of an incremental one, on the same tree
+ */
+void benchIncrementalRebalance() {
+    const int numKeys = 2000000;
+    const int budget = 10000;
+    mt19937 rng(343);
+    vector<int> keys(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = i;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    BST<int> full;
+    for (int key : keys) {
+        full.Add(key);
+    }
+    BST<int> incremental(full);
+
+    cout << "Rebalance, " << numKeys << " keys" << endl;
+    auto start = chrono::steady_clock::now();
+    full.Rebalance();
+    auto stop = chrono::steady_clock::now();
+    cout << "  Rebalance()         : "
+         << chrono::duration<double, milli>(stop - start).count()
+         << " ms" << endl;
+
+    double longest = 0;
+    int steps = 0;
+    incremental.StartRebalance();
+    bool done = false;
+    while (!done) {
+        start = chrono::steady_clock::now();
+        done = incremental.RebalanceStep(budget);
+        stop = chrono::steady_clock::now();
+        longest = max(longest,
+                      chrono::duration<double, milli>(stop - start).count());
+        steps++;
+    }
+    cout << "  RebalanceStep(" << budget << "): " << steps
+         << " steps, longest " << longest << " ms, height "
+         << incremental.getHeight() << endl;
+}
+
+/**
+ * Time for Clear() to return on a large tree, freeing on the calling
+ * thread against handing the nodes to the background reclaimer
+ */
+void benchBackgroundClear() {
+    const int numKeys = 2000000;
+    mt19937 rng(343);
+    vector<int> keys(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = i;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+
+    cout << "Clear, " << numKeys << " keys" << endl;
+    for (bool background : {false, true}) {
+        BST<int> tree(keys.data(), numKeys);
+        tree.SetBackgroundRelease(background);
+        auto start = chrono::steady_clock::now();
+        tree.Clear();
+        auto stop = chrono::steady_clock::now();
+        BST<int>::DrainBackgroundRelease();
+        auto drained = chrono::steady_clock::now();
+        cout << (background ? "  background: " : "  in place  : ")
+             << chrono::duration<double, milli>(stop - start).count()
+             << " ms to return, "
+             << chrono::duration<double, milli>(drained - start).count()
+             << " ms until freed" << endl;
+    }
+}
+
+/**
+ * Lookups where 90% of the keys are missing, with and without the Bloom
+ * filter prefilter, on the same balanced tree
+ */
+void benchPrefilter() {
+    const int numKeys = 1000000;
+    const int numLookups = 2000000;
+    mt19937 rng(343);
+    vector<int> keys(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = i * 2;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    BST<int> plain(keys.data(), numKeys);
+    BST<int> filtered(plain);
+    filtered.SetPrefilter(true, 0.01);
+
+    // odd keys are never in the tree
+    uniform_int_distribution<int> pick(0, numKeys - 1);
+    uniform_int_distribution<int> percent(0, 99);
+    vector<int> trace(numLookups);
+    for (int i = 0; i < numLookups; i++) {
+        trace[i] = pick(rng) * 2 + (percent(rng) < 90 ? 1 : 0);
+    }
+
+    cout << "Lookups with 90% misses, " << numKeys << " keys" << endl;
+    timeLookups("  no prefilter ", plain, trace);
+    timeLookups("  prefilter    ", filtered, trace);
+    cout << "  estimated false positive rate "
+         << filtered.PrefilterFalsePositiveRate() << endl;
+}
+
+/**
+ * Nearly sorted lookups (ascending keys with small random steps) on a
+ * balanced tree, searching from the root and from the finger
+ */
+void benchFingerSearch() {
+    const int numKeys = 1000000;
+    const int numLookups = 2000000;
+    mt19937 rng(343);
+    vector<int> keys(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = i * 2;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    BST<int> plain(keys.data(), numKeys);
+    BST<int> fingered(plain);
+    fingered.SetFingerSearch(true);
+
+    uniform_int_distribution<int> stepSize(0, 8);
+    vector<int> trace(numLookups);
+    int key = 0;
+    for (int i = 0; i < numLookups; i++) {
+        key = (key + stepSize(rng)) % (numKeys * 2);
+        trace[i] = key;
+    }
+
+    cout << "Nearly sorted lookups, " << numKeys << " keys" << endl;
+    timeLookups("  from root   ", plain, trace);
+    timeLookups("  from finger ", fingered, trace);
+}
+
+/**
+ * Random inserts, then lookups of the same keys, from 1, 2, 4 and 8
+ * threads into a ShardedBST with one shard per thread. Scaling needs as
+ * many free cores
+ */
+void benchShardedInserts() {
+    const int numKeys = 2000000;
+    mt19937 rng(343);
+    vector<int> keys(numKeys);
+    for (int i = 0; i < numKeys; i++) {
+        keys[i] = i;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+
+    cout << "Concurrent random inserts and lookups, " << numKeys << " keys, "
+         << thread::hardware_concurrency() << " hardware threads" << endl;
+    for (int numWriters : {1, 2, 4, 8}) {
+        ShardedBST<int> tree(numWriters);
+        double seconds[2];
+        for (int phase = 0; phase < 2; phase++) {
+            auto start = chrono::steady_clock::now();
+            vector<thread> workers;
+            for (int w = 0; w < numWriters; w++) {
+                workers.push_back(thread([&tree, &keys, w, numWriters,
+                                          phase]() {
+                    for (int i = w; i < numKeys; i += numWriters) {
+                        if (phase == 0) {
+                            tree.Add(keys[i]);
+                        } else {
+                            tree.Contains(keys[i]);
+                        }
+                    }
+                }));
+            }
+            for (thread &worker : workers) {
+                worker.join();
+            }
+            auto stop = chrono::steady_clock::now();
+            seconds[phase] = chrono::duration<double>(stop - start).count();
+        }
+        cout << "  " << numWriters << " threads: "
+             << numKeys / seconds[0] / 1e6 << " M inserts/s, "
+             << numKeys / seconds[1] / 1e6 << " M lookups/s, "
+             << tree.NumberOfShards() << " shards" << endl;
+    }
+}
+
+int main() {
+    benchZipfLookups(1.1);
+    benchZipfLookups(1.3);
+    benchCompactLookups();
+    benchBufferedInserts();
+    benchIncrementalRebalance();
+    benchBackgroundClear();
+    benchPrefilter();
+    benchFingerSearch();
+    benchShardedInserts();
+    return 0;
+}
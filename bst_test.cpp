@@ -5,12 +5,19 @@
  * @date February 2, 2019
  */
 
+#include <atomic>
 #include <iostream>
 #include <sstream>
 #include <cassert>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "bst.hpp"
+#include "bstmap.hpp"
+#include "compact_bst.hpp"
+#include "sharded_bst.hpp"
+#include "static_bst.hpp"
 
 using namespace std;
 
@@ -200,6 +207,1061 @@ void test_Assignment() {
     cout << "Second BST changed successfully" << endl;
 }
 
+/**
+ * Self-adjusting mode: accessed keys are splayed to the root while the
+ * contents and inorder order of the tree stay the same
+ */
+void test_SelfAdjusting() {
+    cout << "\n\nTesting self-adjusting (splay) mode" << endl;
+    int quickInt[]={8, 15, 22, 4, 6, 12, 1};
+    BST<int> b1(quickInt, 7);
+    b1.SetSelfAdjusting(true);
+    assert(b1.IsSelfAdjusting() == 1);
+
+    // a hit moves the key to the root
+    assert(b1.Contains(22) == 1);
+    TreeVisitor::ResetSS();
+    b1.PreorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS().substr(0, 2) == "22");
+    // a miss still answers correctly
+    assert(b1.Contains(5) == 0);
+
+    // Add splays the new key to the root, duplicates are still rejected
+    assert(b1.Add(3) == 1);
+    assert(b1.Add(3) == 0);
+    TreeVisitor::ResetSS();
+    b1.PreorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS().substr(0, 1) == "3");
+
+    // restructuring never changes the inorder sequence
+    TreeVisitor::ResetSS();
+    b1.InorderTraverse(TreeVisitor::visitor);
+    string result = "13468121522";
+    assert(TreeVisitor::GetSS() == result);
+    assert(b1.NumberOfNodes() == 8);
+    assert(b1.Remove(12) == 1);
+    assert(b1.Contains(12) == 0);
+
+    // sequential adds degenerate the tree, Rebalance still fixes it
+    BST<int> b2;
+    b2.SetSelfAdjusting(true);
+    for (int i = 0; i < 15; i++) {
+        b2.Add(i);
+    }
+    assert(b2.getHeight() == 15);
+    b2.Rebalance();
+    assert(b2.getHeight() == 4);
+    for (int i = 0; i < 15; i++) {
+        assert(b2.Contains(i) == 1);
+    }
+    cout << "Self-adjusting mode successful!" << endl;
+}
+
+/**
+ * CompactBST keeps the BST interface, so this replays test_jenna90 and the
+ * array traversal checks against it, then checks free slot reuse and that
+ * a node really is key + two 32-bit indices
+ */
+void test_Compact() {
+    cout << "\n\nTesting CompactBST" << endl;
+    CompactBST<int> b1(1);
+    b1.Add(4);
+    b1.Add(8);
+    b1.Add(3);
+    b1.Add(12);
+    b1.Add(9);
+    b1.Add(-24);
+    assert(b1.Add(4) == 0);
+    TreeVisitor::ResetSS();
+    b1.InorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "-241348912");
+    assert(b1.getHeight() == 5);
+    assert(b1.NumberOfNodes() == 7);
+
+    assert(b1.Remove(1) == 1);
+    assert(b1.Remove(4) == 1);
+    assert(b1.Remove(9) == 1);
+    assert(b1.Remove(0) == 0);
+    TreeVisitor::ResetSS();
+    b1.InorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "-243812");
+    assert(b1.getHeight() == 3);
+    assert(b1.NumberOfNodes() == 4);
+
+    // freed slots are reused before the vector grows
+    size_t before = b1.MemoryUsage();
+    b1.Add(5);
+    b1.Add(6);
+    b1.Add(7);
+    assert(b1.MemoryUsage() == before);
+    assert(b1.NumberOfNodes() == 7);
+
+    int quickInt[]={8, 15, 22, 4, 6, 12, 1};
+    CompactBST<int> b2(quickInt, 7);
+    TreeVisitor::ResetSS();
+    b2.PreorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "8416151222");
+    TreeVisitor::ResetSS();
+    b2.PostorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "1641222158");
+    assert(b2.MemoryUsage() == 7 * (sizeof(int) + 2 * sizeof(uint32_t)));
+
+    // copy, assignment and equality
+    CompactBST<int> b3(b2);
+    assert(b3 == b2);
+    CompactBST<int> b4;
+    b4 = b2;
+    assert(b4 == b2);
+    b4.Remove(8);
+    assert(b4 != b2);
+    assert(b4.Contains(8) == 0);
+    b4.Clear();
+    assert(b4.IsEmpty() == 1);
+    assert(b4.MemoryUsage() == 0);
+
+    // Add grows the vector by half, ShrinkToFit drops free slots and spare
+    // capacity without changing the shape
+    size_t nodeSize = sizeof(int) + 2 * sizeof(uint32_t);
+    CompactBST<int> b5;
+    for (int i = 0; i < 1000; i++) {
+        b5.Add((i * 7919) % 1000);
+    }
+    assert(b5.MemoryUsage() <= 1500 * nodeSize + nodeSize);
+    for (int i = 0; i < 1000; i += 3) {
+        b5.Remove(i);
+    }
+    CompactBST<int> b6(b5);
+    b5.ShrinkToFit();
+    assert(b5 == b6);
+    assert(b5.MemoryUsage() == 666 * nodeSize);
+    assert(b5.Add(0) == 1);
+    assert(b5.Contains(0) == 1);
+    assert(b5.NumberOfNodes() == 667);
+    cout << "CompactBST successful!" << endl;
+}
+
+// predicate for RemoveIf tests
+bool isEven(const int &item) {
+    return item % 2 == 0;
+}
+
+/**
+ * Remove must handle the root with zero, one and two children, and the bulk
+ * removals must leave the right items behind
+ */
+void test_RemoveBulk() {
+    cout << "\n\nTesting Remove, RemoveIf and RemoveRange" << endl;
+    // root with only a right child
+    BST<int> b1(1);
+    b1.Add(2);
+    b1.Add(3);
+    assert(b1.Remove(1) == 1);
+    assert(b1.Contains(1) == 0);
+    assert(b1.NumberOfNodes() == 2);
+    // root with only a left child
+    BST<int> b2(3);
+    b2.Add(2);
+    assert(b2.Remove(3) == 1);
+    assert(b2.NumberOfNodes() == 1);
+    // root that is a leaf
+    assert(b2.Remove(2) == 1);
+    assert(b2.IsEmpty() == 1);
+    assert(b2.Remove(2) == 0);
+
+    // two children, successor deeper in the right subtree
+    int quickInt[]={8, 15, 22, 4, 6, 12, 1};
+    BST<int> b3(quickInt, 7);
+    b3.Add(13);
+    assert(b3.Remove(8) == 1);
+    TreeVisitor::ResetSS();
+    b3.PreorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "12416151322");
+
+    // RemoveIf relinks survivors into a balanced tree
+    BST<int> b4;
+    for (int i = 1; i <= 30; i++) {
+        b4.Add(i);
+    }
+    assert(b4.RemoveIf(isEven) == 15);
+    assert(b4.NumberOfNodes() == 15);
+    assert(b4.getHeight() == 4);
+    TreeVisitor::ResetSS();
+    b4.InorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "1357911131517192123252729");
+    assert(b4.RemoveIf(isEven) == 0);
+
+    // RemoveRange is inclusive at both ends
+    int rangeInt[]={10, 20, 30, 40, 50, 60, 70};
+    BST<int> b5(rangeInt, 7);
+    assert(b5.RemoveRange(15, 50) == 4);
+    TreeVisitor::ResetSS();
+    b5.InorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "106070");
+    assert(b5.RemoveRange(60, 60) == 1);
+    assert(b5.RemoveRange(50, 40) == 0);
+    assert(b5.RemoveRange(0, 100) == 2);
+    assert(b5.IsEmpty() == 1);
+    cout << "Bulk removal successful!" << endl;
+}
+
+/**
+ * Lazy deletion leaves tombstones that lookups and traversals skip, and
+ * compacts them away once they pass the configured share of the tree
+ */
+void test_LazyDelete() {
+    cout << "\n\nTesting lazy deletion" << endl;
+    int quickInt[]={8, 15, 22, 4, 6, 12, 1};
+    BST<int> b1(quickInt, 7);
+    b1.SetLazyDelete(true, 0.5);
+    assert(b1.IsLazyDelete() == 1);
+
+    // removing the root leaves the shape alone
+    assert(b1.Remove(8) == 1);
+    assert(b1.Remove(8) == 0);
+    assert(b1.Contains(8) == 0);
+    assert(b1.NumberOfNodes() == 6);
+    assert(b1.NumberOfTombstones() == 1);
+    assert(b1.getHeight() == 3);
+    TreeVisitor::ResetSS();
+    b1.PreorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "416151222");
+
+    // adding a tombstoned item brings the node back
+    assert(b1.Add(8) == 1);
+    assert(b1.Add(8) == 0);
+    assert(b1.NumberOfTombstones() == 0);
+    assert(b1.NumberOfNodes() == 7);
+
+    // a copy keeps its tombstones
+    b1.Remove(1);
+    b1.Remove(4);
+    BST<int> b2(b1);
+    assert(b2 == b1);
+    assert(b2.NumberOfTombstones() == 2);
+
+    // the fourth tombstone passes half of the 7 nodes and compacts
+    b1.Remove(6);
+    assert(b1.NumberOfTombstones() == 3);
+    b1.Remove(22);
+    assert(b1.NumberOfTombstones() == 0);
+    assert(b1.NumberOfNodes() == 3);
+    TreeVisitor::ResetSS();
+    b1.InorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "81215");
+    assert(b1.getHeight() == 2);
+
+    // turning the mode off compacts any remaining tombstones
+    b2.SetLazyDelete(false);
+    assert(b2.NumberOfTombstones() == 0);
+    assert(b2.NumberOfNodes() == 5);
+    assert(b2.Remove(15) == 1);
+    assert(b2.NumberOfNodes() == 4);
+
+    // a ratio of 1 or more is clamped, so removing everything still
+    // compacts and the tree reads as empty
+    BST<int> b3(quickInt, 3);
+    b3.SetLazyDelete(true, 1.0);
+    assert(b3.Remove(8) && b3.Remove(15));
+    assert(!b3.IsEmpty());
+    assert(b3.Remove(22));
+    assert(b3.IsEmpty());
+    assert(b3.NumberOfNodes() == 0);
+    assert(b3.NumberOfTombstones() == 0);
+    assert(b3.getHeight() == 0);
+    cout << "Lazy deletion successful!" << endl;
+}
+
+/**
+ * Buffered writes are visible to Contains and the traversals before and
+ * after the buffer is merged, and duplicates of tree items are dropped
+ */
+void test_WriteBuffer() {
+    cout << "\n\nTesting buffered writes" << endl;
+    int quickInt[]={8, 15, 22, 4, 6, 12, 1};
+    BST<int> b1(quickInt, 7);
+    b1.SetWriteBuffer(4);
+
+    // buffered, not yet in the tree
+    assert(b1.Add(13) == 1);
+    assert(b1.Add(5) == 1);
+    assert(b1.Add(5) == 0);
+    assert(b1.NumberOfBuffered() == 2);
+    assert(b1.Contains(13) == 1);
+    assert(b1.Contains(5) == 1);
+    assert(b1.Contains(7) == 0);
+
+    // removing a buffered item
+    assert(b1.Remove(13) == 1);
+    assert(b1.Contains(13) == 0);
+
+    // a duplicate of a tree item is accepted into the buffer, then the
+    // fourth buffered item fills it and everything is merged
+    assert(b1.Add(8) == 1);
+    b1.Add(2);
+    b1.Add(30);
+    assert(b1.NumberOfBuffered() == 0);
+    assert(b1.NumberOfNodes() == 10);
+    TreeVisitor::ResetSS();
+    b1.InorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "12456812152230");
+
+    // traversals and counts merge pending writes first
+    b1.Add(3);
+    assert(b1.NumberOfBuffered() == 1);
+    TreeVisitor::ResetSS();
+    b1.PreorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "621435158122230");
+    assert(b1.NumberOfBuffered() == 0);
+
+    // a copy sees buffered items, turning the mode off merges
+    b1.Add(40);
+    BST<int> b2(b1);
+    assert(b2.Contains(40) == 1);
+    assert(b2 == b1);
+    b1.Add(50);
+    b1.SetWriteBuffer(0);
+    assert(b1.NumberOfBuffered() == 0);
+    assert(b1.NumberOfNodes() == 13);
+    assert(b1.Add(50) == 0);
+
+    // out of order adds go to the unsorted tail, which is sorted into the
+    // run as it grows; lookups, duplicates and removals see both parts
+    BST<int> b3;
+    for (int i = 0; i < 2000; i++) {
+        b3.Add(i * 2);
+    }
+    b3.SetWriteBuffer(500);
+    for (int i = 0; i < 400; i++) {
+        assert(b3.Add((i * 263) % 400 * 2 + 1) == 1);
+    }
+    assert(b3.NumberOfBuffered() == 400);
+    assert(b3.Add(263 * 2 + 1) == 0);
+    assert(b3.Add(399 * 2 + 1) == 0);
+    for (int i = 0; i < 800; i++) {
+        assert(b3.Contains(i) == 1);
+    }
+    assert(b3.Contains(801) == 0);
+    assert(b3.Remove(1) == 1);
+    assert(b3.Remove((399 * 263) % 400 * 2 + 1) == 1);
+    assert(b3.Contains(1) == 0);
+    assert(b3.NumberOfBuffered() == 398);
+    b3.Flush();
+    assert(b3.NumberOfNodes() == 2398);
+    int expected = 0;
+    for (int i = 0; i < 800; i++) {
+        expected += b3.Contains(i);
+    }
+    assert(expected == 798);
+    cout << "Buffered writes successful!" << endl;
+}
+
+// an item type with comparisons but no std::hash
+struct Version {
+    int major;
+    int minor;
+};
+bool operator==(const Version &a, const Version &b) {
+    return a.major == b.major && a.minor == b.minor;
+}
+bool operator<(const Version &a, const Version &b) {
+    return a.major < b.major || (a.major == b.major && a.minor < b.minor);
+}
+bool operator>(const Version &a, const Version &b) {
+    return b < a;
+}
+
+// true if the hashes kept by bst match ones computed from scratch
+bool hashIsCurrent(const BST<int, true> &bst) {
+    BST<int, true> fresh(bst);
+    fresh.SetHashing(false);
+    fresh.SetHashing(true);
+    return fresh.RootHash() == bst.RootHash();
+}
+
+/**
+ * Subtree hashes stay current through every kind of modification, equal
+ * trees compare equal by hash and Diff lists exactly the differing items
+ */
+void test_Hashing() {
+    cout << "\n\nTesting subtree hashes and Diff" << endl;
+    BST<int, true> b1;
+    assert(b1.IsHashing() == 1);
+    for (int i : {50, 30, 70, 20, 40, 60, 80, 35, 45, 65}) {
+        b1.Add(i);
+        assert(hashIsCurrent(b1));
+    }
+    // leaf, one child and two children removals
+    b1.Remove(20);
+    assert(hashIsCurrent(b1));
+    b1.Remove(60);
+    assert(hashIsCurrent(b1));
+    b1.Remove(30);
+    assert(hashIsCurrent(b1));
+    b1.Remove(50);
+    assert(hashIsCurrent(b1));
+
+    // bulk removals and rebalancing
+    b1.RemoveIf(isEven);
+    assert(hashIsCurrent(b1));
+    for (int i = 1; i < 40; i += 3) {
+        b1.Add(i);
+    }
+    b1.RemoveRange(10, 30);
+    assert(hashIsCurrent(b1));
+    b1.Rebalance();
+    assert(hashIsCurrent(b1));
+
+    // tombstones, splaying and buffered writes
+    b1.SetLazyDelete(true);
+    b1.Remove(37);
+    assert(hashIsCurrent(b1));
+    b1.Add(37);
+    assert(hashIsCurrent(b1));
+    b1.SetSelfAdjusting(true);
+    b1.Contains(4);
+    b1.Contains(100);
+    b1.Add(90);
+    assert(hashIsCurrent(b1));
+    b1.SetSelfAdjusting(false);
+    // a one item batch is inserted, a larger one relinks the tree
+    b1.SetWriteBuffer(1);
+    b1.Add(95);
+    assert(hashIsCurrent(b1));
+    b1.SetWriteBuffer(2);
+    b1.Add(91);
+    b1.Add(92);
+    assert(hashIsCurrent(b1));
+    b1.SetWriteBuffer(0);
+
+    // equal copies compare equal, a single change is found by Diff
+    BST<int, true> b2(b1);
+    assert(b2 == b1);
+    assert(b2.Diff(b1).empty());
+    b2.Remove(4);
+    b2.Add(5);
+    assert(b2 != b1);
+    vector<int> diff = b2.Diff(b1);
+    assert(diff.size() == 2 && diff[0] == 4 && diff[1] == 5);
+
+    // trees with different shapes still diff correctly
+    BST<int, true> b3;
+    b3.Add(5);
+    b3.Add(1);
+    b3.Add(9);
+    BST<int, true> b4;
+    b4.Add(1);
+    b4.Add(9);
+    b4.Add(7);
+    assert(b3 != b4);
+    diff = b3.Diff(b4);
+    assert(diff.size() == 2 && diff[0] == 5 && diff[1] == 7);
+
+    // a small batch into a large tree is merged by resumed descents
+    BST<int, true> b5;
+    for (int i = 0; i < 100; i++) {
+        b5.Add((i * 37) % 100 * 10);
+    }
+    b5.SetWriteBuffer(5);
+    for (int i : {5, 95, 96, 505, 999}) {
+        b5.Add(i);
+    }
+    assert(b5.NumberOfNodes() == 105);
+    assert(hashIsCurrent(b5));
+
+    // every constructor leaves the root hash current
+    BST<int, true> b8(5);
+    BST<int, true> b9;
+    b9.Add(5);
+    assert(hashIsCurrent(b8));
+    assert(b8 == b9);
+    assert(b8.RootHash() == b9.RootHash());
+    int items[] = {4, 2, 6, 1, 3, 5, 7};
+    BST<int, true> b10(items, 7);
+    BST<int, true> b11;
+    for (int i : items) {
+        b11.Add(i);
+    }
+    assert(hashIsCurrent(b10));
+    assert(b10 == b11);
+    BST<int, true> b12(b10);
+    assert(hashIsCurrent(b12));
+    assert(b12 == b10);
+
+    // a plain BST needs no std::hash for its items
+    BST<Version> b6;
+    b6.Add({1, 2});
+    b6.Add({1, 0});
+    b6.Add({2, 0});
+    assert(b6.Contains({1, 0}) == 1);
+    assert(b6.Remove({1, 2}) == 1);
+    assert(b6.NumberOfNodes() == 2);
+    BST<Version> b7(b6);
+    assert(b7 == b6);
+    assert(b7.Diff(b6).empty());
+    cout << "Subtree hashes successful!" << endl;
+}
+
+// a map value with no default constructor
+struct Reading {
+    explicit Reading(int value) : value(value) {}
+    int value;
+};
+
+// visitor for BSTMap traversal tests
+void mapVisitor(const string &key, const int &value) {
+    TreeVisitor::SS << key << "=" << value << ";";
+}
+
+/**
+ * BSTMap stores values inline, updates them in place through Find and
+ * operator[], and only builds values for TryEmplace when inserting
+ */
+void test_Map() {
+    cout << "\n\nTesting BSTMap" << endl;
+    BSTMap<string, int> m1;
+    assert(m1.IsEmpty() == 1);
+    assert(m1.Insert("m", 1) == 1);
+    assert(m1.Insert("c", 2) == 1);
+    assert(m1.Insert("x", 3) == 1);
+    // Insert leaves an existing value alone
+    assert(m1.Insert("m", 100) == 0);
+    assert(*m1.Find("m") == 1);
+    assert(m1.Find("q") == nullptr);
+    assert(m1.NumberOfNodes() == 3);
+
+    // in-place updates
+    *m1.Find("c") += 10;
+    assert(*m1.Find("c") == 12);
+    assert(m1.InsertOrAssign("x", 30) == 0);
+    assert(m1.InsertOrAssign("a", 4) == 1);
+    m1["x"]++;
+    m1["z"] = 26;
+    assert(m1["q"] == 0);
+    assert(m1.TryEmplace("a", 99) == 0);
+    assert(m1.TryEmplace("b", 5) == 1);
+
+    TreeVisitor::ResetSS();
+    m1.InorderTraverse(mapVisitor);
+    assert(TreeVisitor::GetSS() == "a=4;b=5;c=12;m=1;q=0;x=31;z=26;");
+
+    // removal by key, copies are independent
+    BSTMap<string, int> m2(m1);
+    assert(m1.Remove("m") == 1);
+    assert(m1.Remove("m") == 0);
+    assert(m1.Contains("m") == 0);
+    assert(m2.Contains("m") == 1);
+    assert(m1.NumberOfNodes() == 6);
+    m1.Rebalance();
+    assert(m1.getHeight() == 3);
+    assert(*m1.Find("z") == 26);
+    m1.Clear();
+    assert(m1.IsEmpty() == 1);
+
+    // values need no default constructor, TryEmplace builds them in place
+    BSTMap<int, Reading> m3;
+    assert(m3.TryEmplace(1, 5) == 1);
+    assert(m3.TryEmplace(1, 6) == 0);
+    assert(m3.Insert(2, Reading(7)) == 1);
+    assert(m3.Find(1)->value == 5 && m3.Find(2)->value == 7);
+    assert(m3.Remove(1) == 1);
+    assert(m3.TryEmplace(1, 8) == 1);
+    assert(m3.Find(1)->value == 8);
+    cout << "BSTMap successful!" << endl;
+}
+
+/**
+ * Multiset mode keeps one node per distinct item with a count of copies,
+ * through Add, Remove, traversals, hashing, lazy deletion and splaying
+ */
+void test_Multiset() {
+    cout << "\n\nTesting multiset mode" << endl;
+    BST<int, true> b1;
+    b1.SetMultiset(true);
+    assert(b1.IsMultiset() == 1);
+    for (int i : {5, 3, 8, 3, 3, 8}) {
+        assert(b1.Add(i) == 1);
+    }
+    assert(b1.NumberOfNodes() == 3);
+    assert(b1.getHeight() == 2);
+    assert(b1.Count(3) == 3);
+    assert(b1.Count(8) == 2);
+    assert(b1.Count(4) == 0);
+    TreeVisitor::ResetSS();
+    b1.InorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "358");
+    TreeVisitor::ResetSS();
+    b1.InorderTraverse(TreeVisitor::visitor, true);
+    assert(TreeVisitor::GetSS() == "333588");
+    TreeVisitor::ResetSS();
+    b1.PreorderTraverse(TreeVisitor::visitor, true);
+    assert(TreeVisitor::GetSS() == "533388");
+
+    // Remove takes one copy away, the node goes with the last one
+    assert(b1.Remove(8) == 1);
+    assert(b1.Count(8) == 1);
+    assert(b1.Contains(8) == 1);
+    assert(b1.Remove(8) == 1);
+    assert(b1.Remove(8) == 0);
+    assert(b1.Contains(8) == 0);
+    assert(b1.NumberOfNodes() == 2);
+
+    // counts survive copies and Rebalance, and are part of equality
+    BST<int, true> b2(b1);
+    assert(b2 == b1);
+    b2.Add(3);
+    assert(b2 != b1);
+    b2.Rebalance();
+    assert(b2.Count(3) == 4);
+
+    // hashes and Diff see the counts
+    b1.Add(5);
+    assert(hashIsCurrent(b1));
+    b1.Remove(5);
+    assert(hashIsCurrent(b1));
+    vector<int> diff = b1.Diff(b2);
+    assert(diff.size() == 1 && diff[0] == 3);
+
+    // a tombstone comes back holding one copy
+    BST<int> b3;
+    b3.SetMultiset(true);
+    b3.SetLazyDelete(true, 0.9);
+    b3.Add(10);
+    b3.Add(20);
+    b3.Remove(10);
+    assert(b3.NumberOfTombstones() == 1);
+    assert(b3.Add(10) == 1);
+    assert(b3.Count(10) == 1);
+    assert(b3.NumberOfTombstones() == 0);
+
+    // splaying Add counts the copy at the root
+    b3.SetSelfAdjusting(true);
+    b3.Add(20);
+    b3.Add(10);
+    assert(b3.Count(20) == 2);
+    assert(b3.Count(10) == 2);
+
+    // leaving the mode keeps one copy of each item
+    b1.SetMultiset(false);
+    assert(b1.Count(3) == 1);
+    assert(b1.Add(3) == 0);
+    assert(hashIsCurrent(b1));
+    cout << "Multiset mode successful!" << endl;
+}
+
+/**
+ * Incremental rebalance keeps every item reachable between steps and ends
+ * with the same tree as Rebalance; incremental release frees detached
+ * nodes a few at a time
+ */
+void test_IncrementalRebalance() {
+    cout << "\n\nTesting incremental rebalance and release" << endl;
+    // sorted adds give a 100 node chain
+    BST<int> b1;
+    for (int i = 1; i <= 100; i++) {
+        b1.Add(i);
+    }
+    BST<int> expected(b1);
+    expected.Rebalance();
+    assert(b1.getHeight() == 100);
+
+    b1.StartRebalance();
+    assert(b1.IsRebalancing() == 1);
+    int steps = 0;
+    while (!b1.RebalanceStep(16)) {
+        steps++;
+        // lookups see the old tree until the copy is swapped in
+        for (int i = 1; i <= 100; i++) {
+            assert(b1.Contains(i) == 1);
+        }
+        assert(b1.Contains(101) == 0);
+    }
+    // 100 items copied, 100 nodes built, 100 old nodes freed
+    assert(steps == 18);
+    assert(b1.IsRebalancing() == 0);
+    assert(b1 == expected);
+    assert(b1.getHeight() == 7);
+
+    // a change between steps restarts the copy and is kept
+    BST<int> b2;
+    b2.SetLazyDelete(true, 0.9);
+    for (int i = 1; i <= 20; i++) {
+        b2.Add(i);
+    }
+    b2.Remove(5);
+    b2.StartRebalance();
+    b2.RebalanceStep(10);
+    b2.Add(21);
+    b2.Remove(6);
+    while (!b2.RebalanceStep(10)) {}
+    assert(b2.Contains(21) == 1);
+    assert(b2.Contains(6) == 0);
+    assert(b2.NumberOfNodes() == 19);
+    assert(b2.NumberOfTombstones() == 0);
+    assert(b2.getHeight() == 5);
+
+    // splaying between steps moves nodes the copy has not reached yet
+    BST<int> b4(b1);
+    b4.SetSelfAdjusting(true);
+    b4.StartRebalance();
+    for (int i = 0; b4.IsRebalancing(); i += 37) {
+        b4.Contains(i % 100 + 1);
+        b4.RebalanceStep(8);
+    }
+    assert(b4 == expected);
+
+    // deferred Clear and operator=, the destructor frees what is left
+    BST<int> b3(expected);
+    b3.SetIncrementalRelease(true);
+    b3.Clear();
+    assert(b3.IsEmpty() == 1);
+    assert(b3.ReclaimStep(60) == 0);
+    assert(b3.ReclaimStep(40) == 1);
+    b3 = expected;
+    b3 = b2;
+    assert(b3 == b2);
+    assert(b3.ReclaimStep(50) == 0);
+    cout << "Incremental rebalance and release successful!" << endl;
+}
+
+/**
+ * Background release hands dropped nodes to the reclaimer thread, and
+ * draining waits until they are all freed
+ */
+void test_BackgroundRelease() {
+    cout << "\n\nTesting background release" << endl;
+    BST<int> b1;
+    b1.SetBackgroundRelease(true);
+    assert(b1.IsBackgroundRelease() == 1);
+    for (int i = 0; i < 1000; i++) {
+        b1.Add(i);
+    }
+    b1.Clear();
+    assert(b1.IsEmpty() == 1);
+    assert(b1.NumberOfNodes() == 0);
+
+    // the tree is usable again straight away
+    int quickInt[]={8, 15, 22, 4, 6, 12, 1};
+    BST<int> b2(quickInt, 7);
+    b1 = b2;
+    assert(b1 == b2);
+    b1 = BST<int>();
+    assert(b1.IsEmpty() == 1);
+
+    // an incremental rebalance hands the old nodes off when it swaps:
+    // 3 nodes down to the smallest item, 7 copied and 7 built
+    b1 = b2;
+    b1.StartRebalance();
+    assert(b1.RebalanceStep(17) == 1);
+    assert(b1 == b2);
+    {
+        // a copy keeps the mode, so its destructor returns straight away
+        BST<int> b3(b1);
+        assert(b3.IsBackgroundRelease() == 1);
+    }
+    BST<int>::DrainBackgroundRelease();
+    assert(Reclaimer::Instance().Pending() == 0);
+    cout << "Background release successful!" << endl;
+}
+
+/**
+ * The Bloom filter prefilter never hides an item that is in the tree, and
+ * rejects most items that are not
+ */
+void test_Prefilter() {
+    cout << "\n\nTesting Contains prefilter" << endl;
+    BST<int> b1;
+    for (int i = 0; i < 1000; i += 2) {
+        b1.Add(i);
+    }
+    b1.SetPrefilter(true, 0.01);
+    assert(b1.IsPrefilter() == 1);
+    for (int i = 1000; i < 4000; i += 2) {
+        b1.Add(i);
+    }
+    for (int i = 0; i < 4000; i++) {
+        assert(b1.Contains(i) == (i % 2 == 0));
+    }
+    double rate = b1.PrefilterFalsePositiveRate();
+    assert(rate > 0 && rate < 0.02);
+
+    // removed items are gone even while still set in the filter, and the
+    // filter is rebuilt once they outnumber the live ones
+    assert(b1.RemoveRange(0, 2999) == 1500);
+    assert(b1.Contains(10) == 0);
+    assert(b1.Remove(3000) == 1);
+    assert(b1.Contains(3000) == 0);
+    assert(b1.PrefilterFalsePositiveRate() < rate);
+    assert(b1.Contains(3002) == 1);
+
+    // buffered, splayed and copied trees keep the filter in step
+    BST<int> b2(b1);
+    b2.SetWriteBuffer(16);
+    b2.Add(5);
+    assert(b2.Contains(5) == 1);
+    b2.SetSelfAdjusting(true);
+    b2.Add(7);
+    assert(b2.Contains(7) == 1);
+    assert(b1.Contains(7) == 0);
+    b2.Rebalance();
+    assert(b2.Contains(5) == 1 && b2.Contains(3998) == 1);
+    b2.Clear();
+    assert(b2.Contains(5) == 0);
+    b2.Add(5);
+    assert(b2.Contains(5) == 1);
+    b2.SetPrefilter(false);
+    assert(b2.PrefilterFalsePositiveRate() == 0);
+    assert(b2.Contains(5) == 1);
+
+    // target rates outside (0, 1) are clamped rather than sizing the
+    // filter from log(0)
+    for (double fpRate : {0.0, -1.0, 1.0, 2.0}) {
+        BST<int> b3;
+        b3.SetPrefilter(true, fpRate);
+        for (int i = 0; i < 100; i += 2) {
+            b3.Add(i);
+        }
+        for (int i = 0; i < 100; i++) {
+            assert(b3.Contains(i) == (i % 2 == 0));
+        }
+    }
+    cout << "Contains prefilter successful!" << endl;
+}
+
+/**
+ * Finger searches find the same items as plain ones whatever order they
+ * come in, and hinted adds build the same tree as plain adds
+ */
+void test_FingerSearch() {
+    cout << "\n\nTesting finger search" << endl;
+    BST<int> b1;
+    for (int i = 0; i < 200; i += 2) {
+        b1.Add(i);
+    }
+    b1.Rebalance();
+    b1.SetFingerSearch(true);
+    assert(b1.IsFingerSearch() == 1);
+    // ascending, descending and jumping around
+    for (int i = 0; i < 200; i++) {
+        assert(b1.Contains(i) == (i % 2 == 0));
+    }
+    for (int i = 199; i >= 0; i--) {
+        assert(b1.Contains(i) == (i % 2 == 0));
+    }
+    for (int i : {150, 3, 198, 0, 100, -1, 200, 101, 42}) {
+        assert(b1.Contains(i) == (i >= 0 && i < 200 && i % 2 == 0));
+    }
+
+    // hinted adds fill the gaps where the finger is
+    BST<int> plain(b1);
+    plain.SetFingerSearch(false);
+    for (int i = 1; i < 200; i += 2) {
+        assert(b1.Add(i) == 1);
+        plain.Add(i);
+    }
+    assert(b1.Add(51) == 0);
+    assert(b1 == plain);
+    assert(b1.NumberOfNodes() == 200);
+
+    // other changes reset the finger
+    b1.Contains(120);
+    b1.RemoveRange(100, 130);
+    assert(b1.Contains(120) == 0);
+    assert(b1.Contains(131) == 1);
+    b1.Remove(131);
+    assert(b1.Contains(131) == 0);
+    assert(b1.Contains(132) == 1);
+
+    // hashes, counts and tombstones through hinted adds
+    BST<int, true> b2;
+    b2.SetFingerSearch(true);
+    b2.SetMultiset(true);
+    b2.SetLazyDelete(true, 0.9);
+    for (int i : {50, 20, 80, 10, 30, 25, 30}) {
+        b2.Add(i);
+    }
+    assert(b2.Count(30) == 2);
+    assert(hashIsCurrent(b2));
+    b2.Remove(25);
+    assert(b2.Add(25) == 1);
+    assert(b2.NumberOfTombstones() == 0);
+    assert(hashIsCurrent(b2));
+    cout << "Finger search successful!" << endl;
+}
+
+// built at compile time, checked by static_assert in test_StaticBST
+constexpr int reservedIds[] = {404, 200, 500, 301, 200, 100, 302, 418};
+constexpr auto reserved = MakeStaticBST(reservedIds);
+static_assert(reserved.NumberOfNodes() == 7, "duplicates are dropped");
+static_assert(reserved.getHeight() == 3, "layout is balanced");
+static_assert(reserved.Contains(418), "");
+static_assert(!reserved.Contains(401), "");
+
+/**
+ * A compile-time StaticBST answers lookups like a BST of the same keys
+ */
+void test_StaticBST() {
+    cout << "\n\nTesting StaticBST" << endl;
+    int ids[] = {404, 200, 500, 301, 200, 100, 302, 418};
+    BST<int> b1(ids, 8);
+    for (int i = 0; i < 600; i++) {
+        assert(reserved.Contains(i) == b1.Contains(i));
+    }
+    TreeVisitor::ResetSS();
+    reserved.InorderTraverse(TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "100200301302404418500");
+
+    constexpr StaticBST<int, 1> single({7});
+    static_assert(single.Contains(7) && !single.Contains(6), "");
+    static_assert(single.getHeight() == 1, "");
+    cout << "StaticBST successful!" << endl;
+}
+
+/**
+ * ShardedBST spreads items over range shards, re-splits as they grow,
+ * and traverses them in order; concurrent writers all land
+ */
+void test_Sharded() {
+    cout << "\n\nTesting ShardedBST" << endl;
+    ShardedBST<int> s1(4);
+    assert(s1.IsEmpty() == 1);
+    assert(s1.NumberOfShards() == 1);
+    // ascending adds keep landing in the last shard, which re-splits
+    BST<int> plain;
+    for (int i = 0; i < 20000; i += 2) {
+        assert(s1.Add(i) == 1);
+        plain.Add(i);
+    }
+    assert(s1.Add(100) == 0);
+    assert(s1.NumberOfNodes() == 10000);
+    assert(s1.NumberOfShards() == 4);
+    for (int size : s1.ShardSizes()) {
+        assert(size <= 5000);
+    }
+    for (int i = 0; i < 20000; i += 999) {
+        assert(s1.Contains(i) == (i % 2 == 0));
+    }
+
+    // traversals span the shards in key order
+    TreeVisitor::ResetSS();
+    s1.InorderTraverse(TreeVisitor::visitor);
+    string all = TreeVisitor::GetSS();
+    TreeVisitor::ResetSS();
+    plain.InorderTraverse(TreeVisitor::visitor);
+    assert(all == TreeVisitor::GetSS());
+    TreeVisitor::ResetSS();
+    s1.RangeTraverse(4995, 5010, TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "49964998500050025004500650085010");
+    TreeVisitor::ResetSS();
+    s1.RangeTraverse(5010, 4995, TreeVisitor::visitor);
+    assert(TreeVisitor::GetSS() == "");
+
+    assert(s1.Remove(5000) == 1);
+    assert(s1.Remove(5000) == 0);
+    assert(s1.Contains(5000) == 0);
+    assert(s1.NumberOfNodes() == 9999);
+    s1.Rebalance();
+    assert(s1.Contains(5002) == 1);
+
+    // shards emptied by removals are merged into their neighbours
+    for (int i = 0; i < 16000; i += 2) {
+        s1.Remove(i);
+    }
+    assert(s1.NumberOfNodes() == 2000);
+    assert(s1.NumberOfShards() < 4);
+    for (int i = 15990; i < 16010; i++) {
+        assert(s1.Contains(i) == (i >= 16000 && i % 2 == 0));
+    }
+    s1.Clear();
+    assert(s1.IsEmpty() == 1);
+    assert(s1.NumberOfShards() == 1);
+
+    // writers with interleaved keys share every shard
+    ShardedBST<int> s2(4);
+    vector<thread> writers;
+    for (int w = 0; w < 4; w++) {
+        writers.push_back(thread([&s2, w]() {
+            for (int i = w; i < 40000; i += 4) {
+                s2.Add(i);
+            }
+        }));
+    }
+    for (thread &writer : writers) {
+        writer.join();
+    }
+    assert(s2.NumberOfNodes() == 40000);
+    for (int i = 0; i < 40000; i += 37) {
+        assert(s2.Contains(i) == 1);
+    }
+
+    // removers, readers and a re-splitting writer at the same time
+    vector<thread> workers;
+    for (int w = 0; w < 2; w++) {
+        workers.push_back(thread([&s2, w]() {
+            for (int i = w; i < 30000; i += 2) {
+                s2.Remove(i);
+            }
+        }));
+    }
+    workers.push_back(thread([&s2]() {
+        for (int i = 40000; i < 50000; i++) {
+            s2.Add(i);
+        }
+    }));
+    workers.push_back(thread([&s2]() {
+        for (int i = 0; i < 20000; i++) {
+            assert(s2.Contains(30000 + i % 10000) == 1);
+        }
+    }));
+    for (thread &worker : workers) {
+        worker.join();
+    }
+    assert(s2.NumberOfNodes() == 20000);
+    for (int i = 29990; i < 50010; i += 7) {
+        assert(s2.Contains(i) == (i >= 30000 && i < 50000));
+    }
+
+    // a sliding window reshards over and over, retired layouts and shards
+    // are freed as it goes, with readers running or not
+    ShardedBST<int> s3(4);
+    int mostRetired = 0;
+    for (int i = 0; i < 200000; i++) {
+        s3.Add(i);
+        if (i >= 8000) {
+            s3.Remove(i - 8000);
+        }
+        if (i % 1000 == 0) {
+            mostRetired = max(mostRetired, s3.NumberOfRetired());
+        }
+    }
+    assert(mostRetired <= 16);
+    atomic<bool> churning{true};
+    vector<thread> readers;
+    for (int r = 0; r < 2; r++) {
+        readers.push_back(thread([&s3, &churning, r]() {
+            for (int i = r; churning.load(); i += 97) {
+                s3.Contains(200000 + i % 100000);
+                s3.NumberOfNodes();
+            }
+        }));
+    }
+    for (int i = 200000; i < 300000; i++) {
+        s3.Add(i);
+        s3.Remove(i - 8000);
+    }
+    churning.store(false);
+    for (thread &reader : readers) {
+        reader.join();
+    }
+    assert(s3.NumberOfNodes() == 8000);
+    // readers may have held back a grace period, the next reshard ends it
+    for (int i = 300000; i < 320000; i++) {
+        s3.Add(i);
+        s3.Remove(i - 8000);
+    }
+    assert(s3.NumberOfRetired() <= 16);
+    cout << "ShardedBST successful!" << endl;
+}
+
 void testBSTConstructors() {
     cout << "\n\n* Testing 0 param constructor, ==, !=, IsEmpty, and XTraverse"
          << endl;
@@ -269,4 +1331,18 @@ void testBSTAll() {
     test_Constructors();
     test_traversal();
     test_Assignment();
+    test_SelfAdjusting();
+    test_Compact();
+    test_RemoveBulk();
+    test_LazyDelete();
+    test_WriteBuffer();
+    test_Hashing();
+    test_Map();
+    test_Multiset();
+    test_IncrementalRebalance();
+    test_BackgroundRelease();
+    test_Prefilter();
+    test_FingerSearch();
+    test_StaticBST();
+    test_Sharded();
 }
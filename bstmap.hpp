@@ -0,0 +1,207 @@
+/**
+ * Binary Search Tree Map - Template
+ *
+ * Key-value map built on BST: each node stores a MapEntry holding the key
+ * and its value inline, so a lookup or an update is a single descent and
+ * no second container is needed for the payloads.
+ * Find returns a pointer to the stored value, which can be changed in place
+ * InsertOrAssign, TryEmplace and operator[] insert or update in one descent
+ */
+
+#ifndef BSTMAP_HPP
+#define BSTMAP_HPP
+
+#include <functional>
+#include <iostream>
+#include <utility>
+
+#include "bst.hpp"
+
+using namespace std;
+
+/**
+ * Entry stored in a BSTMap node. Entries compare by key only, and also
+ * compare directly with a key, so the tree can be searched without
+ * building a whole entry (or a value) first.
+ */
+template<class K, class V>
+struct MapEntry {
+    K key;
+    V value;
+};
+
+template<class K, class V>
+bool operator==(const MapEntry<K, V> &a, const MapEntry<K, V> &b) {
+    return a.key == b.key;
+}
+
+template<class K, class V>
+bool operator<(const MapEntry<K, V> &a, const MapEntry<K, V> &b) {
+    return a.key < b.key;
+}
+
+template<class K, class V>
+bool operator>(const MapEntry<K, V> &a, const MapEntry<K, V> &b) {
+    return b.key < a.key;
+}
+
+template<class K, class V>
+bool operator==(const MapEntry<K, V> &a, const K &key) {
+    return a.key == key;
+}
+
+template<class K, class V>
+bool operator<(const MapEntry<K, V> &a, const K &key) {
+    return a.key < key;
+}
+
+template<class K, class V>
+bool operator>(const MapEntry<K, V> &a, const K &key) {
+    return key < a.key;
+}
+
+// display an entry as key:value
+template<class K, class V>
+ostream &operator<<(ostream &os, const MapEntry<K, V> &entry) {
+    os << entry.key << ":" << entry.value;
+    return os;
+}
+
+template<class K, class V>
+class BSTMap {
+    // display a sideways ascii representation of the map's tree
+    friend ostream &operator<<(ostream &os, const BSTMap &map) {
+        os << map.tree;
+        return os;
+    }
+
+ private:
+    typedef MapEntry<K, V> Entry;
+    typedef typename BST<Entry>::Node Node;
+
+    // the entries, ordered by key
+    BST<Entry> tree;
+
+    // inorder walk handing each key and value to visit
+    static void inorderHelper(void visit(const K &key, const V &value),
+                              const Node* root) {
+        if (root) {
+            inorderHelper(visit, root->leftPtr);
+            if (root->count > 0) visit(root->data.key, root->data.value);
+            inorderHelper(visit, root->rightPtr);
+        }
+    }
+
+ public:
+    /*************************************/
+    //         Constructors              //
+    /*************************************/
+    // constructor, empty map
+    BSTMap() = default;
+
+    // copy constructor, copies every entry
+    BSTMap(const BSTMap<K, V> &map) : tree(map.tree) {
+    }
+
+    BSTMap<K, V>& operator=(const BSTMap<K, V> &that) {
+        tree = that.tree;
+        return *this;
+    }
+
+    /*************************************/
+    //          Functions                //
+    /*************************************/
+    // true if the map has no entries
+    bool IsEmpty() const {
+        return tree.IsEmpty();
+    }
+
+    // number of entries
+    int NumberOfNodes() const {
+        return tree.NumberOfNodes();
+    }
+
+    // height of the underlying tree
+    int getHeight() const {
+        return tree.getHeight();
+    }
+
+    // true if key has an entry
+    bool Contains(const K &key) const {
+        return tree.findNode(key) != nullptr;
+    }
+
+    // pointer to the value stored for key, nullptr if there is none.
+    // The value can be changed through the pointer
+    V* Find(const K &key) {
+        Node* n = tree.findNode(key);
+        return n ? &n->data.value : nullptr;
+    }
+
+    const V* Find(const K &key) const {
+        const Node* n = tree.findNode(key);
+        return n ? &n->data.value : nullptr;
+    }
+
+    // add key with value if key is not in the map yet,
+    // return true if it was added (an existing value is left alone)
+    bool Insert(const K &key, const V &value) {
+        bool inserted;
+        tree.findOrInsert(key, [&]() { return Entry{key, value}; },
+                          inserted);
+        return inserted;
+    }
+
+    // set key to value, adding the entry if needed,
+    // return true if it was added, false if an existing value was replaced
+    bool InsertOrAssign(const K &key, const V &value) {
+        bool inserted;
+        Node* n = tree.findOrInsert(key, [&]() { return Entry{key, value}; },
+                                    inserted);
+        if (!inserted) {
+            n->data.value = value;
+        }
+        return inserted;
+    }
+
+    // add key with a value built from args, only if key is not in the map
+    // yet (the value is not constructed otherwise), return true if added
+    template<class... Args>
+    bool TryEmplace(const K &key, Args&&... args) {
+        bool inserted;
+        tree.findOrInsert(key, [&]() {
+            return Entry{key, V(std::forward<Args>(args)...)};
+        }, inserted);
+        return inserted;
+    }
+
+    // value stored for key, adding a default value first if needed
+    V& operator[](const K &key) {
+        bool inserted;
+        return tree.findOrInsert(key, [&]() { return Entry{key, V()}; },
+                                 inserted)->data.value;
+    }
+
+    // remove key and its value, return true if it was in the map
+    bool Remove(const K &key) {
+        return tree.removeKey(key);
+    }
+
+    // visit every key and value in key order
+    void InorderTraverse(void visit(const K &key, const V &value)) const {
+        tree.flush();
+        inorderHelper(visit, tree.rootPtr);
+    }
+
+    // rebuild the underlying tree balanced
+    void Rebalance() {
+        tree.Rebalance();
+    }
+
+    // delete all entries
+    void Clear() {
+        tree.Clear();
+    }
+};
+
+#endif  // BSTMAP_HPP
@@ -0,0 +1,93 @@
+/**
+ * Background Reclaimer
+ *
+ * One worker thread that runs cleanup tasks handed to it, so a thread
+ * dropping a large tree does not have to free every node itself.
+ * BST uses it in background release mode (SetBackgroundRelease).
+ * Drain() waits until every task submitted so far has run; call it before
+ * shutdown, since the reclaimer is never destroyed and tasks still queued
+ * at exit are not run.
+ */
+
+#ifndef RECLAIMER_HPP
+#define RECLAIMER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+class Reclaimer {
+ public:
+    Reclaimer(const Reclaimer &) = delete;
+    Reclaimer &operator=(const Reclaimer &) = delete;
+
+    // the process wide reclaimer, its thread starts on first use.
+    // It is deliberately leaked: a static object could be destroyed before
+    // a static tree that still hands it work
+    static Reclaimer &Instance() {
+        static Reclaimer *instance = new Reclaimer();
+        return *instance;
+    }
+
+    // queue task to run on the worker thread, returns straight away
+    void Submit(function<void()> task) {
+        {
+            lock_guard<mutex> guard(lock);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // block until every task submitted before the call has run
+    void Drain() {
+        unique_lock<mutex> guard(lock);
+        idle.wait(guard, [this]() { return tasks.empty() && !busy; });
+    }
+
+    // number of tasks queued or running
+    int Pending() {
+        lock_guard<mutex> guard(lock);
+        return static_cast<int>(tasks.size()) + (busy ? 1 : 0);
+    }
+
+ private:
+    Reclaimer() : worker(&Reclaimer::run, this) {
+        worker.detach();
+    }
+
+    // worker loop: run tasks in submission order, without holding the lock
+    void run() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [this]() { return !tasks.empty(); });
+            function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            busy = true;
+            guard.unlock();
+            task();
+            guard.lock();
+            busy = false;
+            if (tasks.empty()) {
+                idle.notify_all();
+            }
+        }
+    }
+
+    mutex lock;
+    // signalled when a task is queued
+    condition_variable wake;
+    // signalled when the queue runs empty
+    condition_variable idle;
+    deque<function<void()>> tasks;
+    // true while a task is running
+    bool busy{false};
+    // declared last so the members above exist before it starts
+    thread worker;
+};
+
+#endif  // RECLAIMER_HPP
@@ -0,0 +1,537 @@
+/**
+ * Range-Sharded Binary Search Tree - Template
+ *
+ * Splits the key space into ranges, each held by its own BST behind its
+ * own mutex, so writers to different ranges never wait for each other.
+ * A sorted splitter array picks the shard: shard i holds the items in
+ * [splitters[i - 1], splitters[i]).
+ * The splitters and shards form an immutable layout published through an
+ * atomic pointer, so Add, Remove and Contains take no lock but their
+ * shard's and write no shared memory outside it but a reader count kept
+ * per thread; each shard counts its own items.
+ * Traversals and range scans walk the shards in key order, locking one
+ * shard at a time, so they see each shard at a single point in time but
+ * not the whole container.
+ * The container starts with one shard and splits shards until it has the
+ * wanted number, then keeps every shard within about twice the average
+ * by re-splitting the largest one with its smaller neighbour (sorted
+ * ingest would otherwise pile into the last shard), and merges
+ * neighbours that have emptied out. Only the shards being replaced are
+ * locked while their items are copied, and their old trees are freed
+ * after the locks are released. Retired layouts and shard headers are
+ * freed after a grace period: lock-free readers count themselves in under
+ * one of two alternating epochs, and whatever was retired before the epoch
+ * last changed is freed once no reader of the old epoch is left.
+ */
+
+#ifndef SHARDED_BST_HPP
+#define SHARDED_BST_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bst.hpp"
+
+using namespace std;
+
+template<class T>
+class ShardedBST {
+ private:
+    // shards are not split below this many items each
+    static const int MIN_SHARD_SIZE = 1024;
+
+    // one key range: its tree and the lock every access to it takes
+    struct Shard {
+        mutex lock;
+        // null once a split, merge or Clear() has retired the shard; an
+        // access that finds it so loads the layout again
+        unique_ptr<BST<T>> tree{new BST<T>()};
+        // items in tree, written under lock, read without it
+        atomic<int> size{0};
+        // Add() checks the balance once size reaches splitCheck, Remove()
+        // once it drops below mergeCheck; both set by checkBalance()
+        atomic<int> splitCheck{2 * MIN_SHARD_SIZE};
+        atomic<int> mergeCheck{0};
+    };
+
+    // shards in key order and the first item of each after the first;
+    // never changed once published
+    struct Layout {
+        vector<Shard*> shards;
+        vector<T> splitters;
+    };
+
+    // layouts and shard headers no longer published
+    struct Retired {
+        vector<unique_ptr<const Layout>> layouts;
+        vector<unique_ptr<Shard>> shards;
+    };
+
+    // a reader count padded to a cache line
+    struct ReaderCount {
+        atomic<int> count{0};
+        char pad[64 - sizeof(atomic<int>)];
+    };
+
+    // reader counts per epoch parity, spread over slots so readers on
+    // different threads do not write the same cache line
+    static const int READER_SLOTS = 16;
+
+    // the current layout, owns its shards
+    atomic<const Layout*> layout{nullptr};
+
+    // bumped when retired memory starts its grace period; readers count
+    // themselves in under its parity
+    atomic<unsigned> epoch{0};
+    mutable ReaderCount readers[2][READER_SLOTS];
+
+    // retired since the epoch last changed, and retired before that, which
+    // is freed once the readers of the previous epoch are gone; both only
+    // touched with topology held
+    Retired retiring;
+    Retired waiting;
+
+    // number of shards wanted
+    int targetShards;
+
+    // held while the layout changes and by traversals, never by Add(),
+    // Remove() or Contains()
+    mutable mutex topology;
+
+    // this thread's slot in readers, handed out round robin
+    static int readerSlot() {
+        static atomic<int> next{0};
+        thread_local int slot =
+                next.fetch_add(1, memory_order_relaxed) % READER_SLOTS;
+        return slot;
+    }
+
+    /**
+     * Counts a lock-free reader in for as long as it lives, so nothing it
+     * reaches through the layout is freed under it. If the epoch changes
+     * while counting in, the count moves to the new epoch, since the old
+     * one may already have been found empty
+     */
+    class ReadGuard {
+     public:
+        explicit ReadGuard(const ShardedBST &bst) {
+            int slot = readerSlot();
+            while (true) {
+                unsigned current = bst.epoch.load();
+                count = &bst.readers[current & 1][slot].count;
+                count->fetch_add(1);
+                if (bst.epoch.load() == current) {
+                    return;
+                }
+                count->fetch_sub(1);
+            }
+        }
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+        ~ReadGuard() {
+            count->fetch_sub(1, memory_order_release);
+        }
+
+     private:
+        atomic<int>* count;
+    };
+
+    // index of the shard in current whose range holds item
+    static int shardIndex(const Layout &current, const T &item) {
+        return static_cast<int>(upper_bound(current.splitters.begin(),
+                                            current.splitters.end(), item)
+                                - current.splitters.begin());
+    }
+
+    /**
+     * Runs op on the live shard whose range holds item, with the shard
+     * locked. A shard retired after the layout was loaded is skipped, by
+     * then the layout replacing it has been published
+     * @param item - the item op works on
+     * @param op - called with the locked shard
+     * @return what op returns
+     */
+    template<class Op>
+    auto withShard(const T &item, Op op) const {
+        while (true) {
+            ReadGuard reading(*this);
+            const Layout &current = *layout.load(memory_order_acquire);
+            Shard &shard = *current.shards[shardIndex(current, item)];
+            lock_guard<mutex> guard(shard.lock);
+            if (shard.tree) {
+                return op(shard);
+            }
+        }
+    }
+
+    /**
+     * Makes next the current layout and retires the previous one along
+     * with the shards next dropped from it, then frees what is past its
+     * grace period. topology must be held
+     * @param next - the new layout
+     * @param dropped - shards of the previous layout not in next
+     */
+    void publish(const Layout* next, const vector<Shard*> &dropped) {
+        const Layout* previous = layout.load(memory_order_relaxed);
+        layout.store(next, memory_order_release);
+        retiring.layouts.emplace_back(previous);
+        for (Shard* shard : dropped) {
+            retiring.shards.emplace_back(shard);
+        }
+        reclaim();
+    }
+
+    // true if no reader is counted in under the given epoch parity
+    bool noReaders(unsigned parity) const {
+        for (const ReaderCount &slot : readers[parity]) {
+            if (slot.count.load() != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Frees the waiting memory once every reader of the previous epoch has
+     * left, then starts the grace period of everything retired since by
+     * moving it to waiting and changing the epoch. Readers counted in
+     * after that cannot reach it, so it is safe once the readers of the
+     * now previous epoch are gone. If some still are, nothing changes
+     * until the next call. topology must be held
+     */
+    void reclaim() {
+        unsigned current = epoch.load(memory_order_relaxed);
+        if (!noReaders((current - 1) & 1)) {
+            return;
+        }
+        waiting = Retired();
+        if (!retiring.layouts.empty() || !retiring.shards.empty()) {
+            swap(waiting, retiring);
+            epoch.store(current + 1);
+        }
+    }
+
+    /**
+     * Replaces shards first..last of the current layout with parts shards
+     * splitting their items evenly, each tree balanced. The replaced
+     * shards stay locked while their items are copied, so only writers to
+     * them wait; their old trees are freed once the locks are released.
+     * topology must be held
+     * @param first - index of the first shard replaced
+     * @param last - index of the last shard replaced
+     * @param parts - number of shards replacing them
+     */
+    void reshard(int first, int last, int parts) {
+        const Layout &current = *layout.load(memory_order_relaxed);
+        vector<unique_ptr<BST<T>>> dead;
+        {
+            vector<unique_lock<mutex>> guards;
+            vector<T> items;
+            for (int i = first; i <= last; i++) {
+                Shard &shard = *current.shards[i];
+                guards.emplace_back(shard.lock);
+                shard.tree->flush();
+                BST<T>::collectItems(shard.tree->rootPtr, items);
+            }
+            Layout* next = new Layout();
+            vector<Shard*> dropped(current.shards.begin() + first,
+                                   current.shards.begin() + last + 1);
+            next->shards.assign(current.shards.begin(),
+                                current.shards.begin() + first);
+            next->splitters.assign(current.splitters.begin(),
+                                   current.splitters.begin() + first);
+            size_t total = items.size();
+            for (int p = 0; p < parts; p++) {
+                size_t start = total * p / parts;
+                size_t end = total * (p + 1) / parts;
+                Shard* shard = new Shard();
+                // sorted adds into the write buffer, merged in one
+                // balanced rebuild by Flush()
+                shard->tree->SetWriteBuffer(static_cast<int>(end - start) + 1);
+                for (size_t j = start; j < end; j++) {
+                    shard->tree->Add(items[j]);
+                }
+                shard->tree->SetWriteBuffer(0);
+                shard->size.store(static_cast<int>(end - start),
+                                  memory_order_relaxed);
+                if (p > 0) {
+                    next->splitters.push_back(items[start]);
+                }
+                next->shards.push_back(shard);
+            }
+            next->shards.insert(next->shards.end(),
+                                current.shards.begin() + last + 1,
+                                current.shards.end());
+            next->splitters.insert(next->splitters.end(),
+                                   current.splitters.begin() + last,
+                                   current.splitters.end());
+            publish(next, dropped);
+            for (Shard* shard : dropped) {
+                dead.push_back(std::move(shard->tree));
+            }
+        }
+        // the old trees are freed here, with no shard locked
+    }
+
+    /**
+     * Splits, re-splits or merges shards until the sizes are in balance:
+     * below the wanted number of shards a shard above the average is
+     * split in two; a shard over twice the average is re-split together
+     * with the fewest neighbours that bring their mean down to 5/4 of the
+     * average, so each reshard leaves room for many inserts before the
+     * next; neighbours that together hold under half the average are
+     * merged. Only shards of at least 2 * MIN_SHARD_SIZE items are split
+     * or re-split. Then resets every shard's check thresholds.
+     * Returns straight away if another thread is already at it.
+     */
+    void checkBalance() {
+        unique_lock<mutex> guard(topology, try_to_lock);
+        if (!guard.owns_lock()) {
+            return;
+        }
+        while (true) {
+            const Layout &current = *layout.load(memory_order_relaxed);
+            int numShards = static_cast<int>(current.shards.size());
+            vector<int> sizes;
+            int total = 0;
+            for (Shard* shard : current.shards) {
+                sizes.push_back(shard->size.load(memory_order_relaxed));
+                total += sizes.back();
+            }
+            int average = total / targetShards;
+            int largest = static_cast<int>(
+                    max_element(sizes.begin(), sizes.end()) - sizes.begin());
+            if (sizes[largest] >= 2 * MIN_SHARD_SIZE) {
+                if (numShards < targetShards && sizes[largest] > average) {
+                    reshard(largest, largest, 2);
+                    continue;
+                }
+                if (sizes[largest] > 2 * average) {
+                    // widen towards the smaller side; all the shards
+                    // together average at most the average
+                    int lo = largest;
+                    int hi = largest;
+                    long long sum = sizes[largest];
+                    while (4 * sum > 5LL * average * (hi - lo + 1)) {
+                        if (hi + 1 == numShards ||
+                            (lo > 0 && sizes[lo - 1] <= sizes[hi + 1])) {
+                            sum += sizes[--lo];
+                        } else {
+                            sum += sizes[++hi];
+                        }
+                    }
+                    reshard(lo, hi, hi - lo + 1);
+                    continue;
+                }
+            }
+            int mergeBelow = max(MIN_SHARD_SIZE, average) / 2;
+            int pair = -1;
+            for (int i = 0; i + 1 < numShards; i++) {
+                if (sizes[i] + sizes[i + 1] < mergeBelow &&
+                    (pair < 0 ||
+                     sizes[i] + sizes[i + 1] < sizes[pair] + sizes[pair + 1])) {
+                    pair = i;
+                }
+            }
+            if (pair >= 0) {
+                reshard(pair, pair + 1, 1);
+                continue;
+            }
+            // next checks: a shard that could now need a split, or one
+            // that has halved or could now be merged
+            int splitAt = max(2 * MIN_SHARD_SIZE,
+                              (numShards < targetShards ? average
+                                                        : 2 * average) + 1);
+            for (int i = 0; i < numShards; i++) {
+                Shard &shard = *current.shards[i];
+                shard.splitCheck.store(splitAt, memory_order_relaxed);
+                shard.mergeCheck.store(max(mergeBelow / 2, sizes[i] / 2),
+                                       memory_order_relaxed);
+            }
+            return;
+        }
+    }
+
+ public:
+    /*************************************/
+    //         Constructors              //
+    /*************************************/
+    // constructor, empty container that will split into numShards ranges,
+    // by default one per hardware thread
+    explicit ShardedBST(int numShards = thread::hardware_concurrency())
+            : targetShards(max(1, numShards)) {
+        Layout* first = new Layout();
+        first->shards.push_back(new Shard());
+        layout.store(first, memory_order_release);
+    }
+
+    // shards hold locks, so the container is not copied
+    ShardedBST(const ShardedBST<T> &) = delete;
+    ShardedBST<T>& operator=(const ShardedBST<T> &) = delete;
+
+    // frees the current layout and its shards; retired ones go with
+    // retiring and waiting
+    ~ShardedBST() {
+        const Layout* current = layout.load(memory_order_relaxed);
+        for (Shard* shard : current->shards) {
+            delete shard;
+        }
+        delete current;
+    }
+
+    /*************************************/
+    //          Functions                //
+    /*************************************/
+    // true if no items in any shard
+    bool IsEmpty() const {
+        return NumberOfNodes() == 0;
+    }
+
+    // number of items over all shards, summed without locking so only
+    // exact while no writer is running
+    int NumberOfNodes() const {
+        ReadGuard reading(*this);
+        int total = 0;
+        for (Shard* shard : layout.load(memory_order_acquire)->shards) {
+            total += shard->size.load(memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // number of key ranges right now
+    int NumberOfShards() const {
+        ReadGuard reading(*this);
+        return static_cast<int>(
+                layout.load(memory_order_acquire)->shards.size());
+    }
+
+    // number of items in each shard, in key order
+    vector<int> ShardSizes() const {
+        ReadGuard reading(*this);
+        vector<int> sizes;
+        for (Shard* shard : layout.load(memory_order_acquire)->shards) {
+            sizes.push_back(shard->size.load(memory_order_relaxed));
+        }
+        return sizes;
+    }
+
+    // number of retired layouts and shards not yet freed
+    int NumberOfRetired() const {
+        lock_guard<mutex> guard(topology);
+        return static_cast<int>(retiring.layouts.size() +
+                                retiring.shards.size() +
+                                waiting.layouts.size() +
+                                waiting.shards.size());
+    }
+
+    // add a new item, return true if successful
+    bool Add(const T &item) {
+        bool check = false;
+        bool added = withShard(item, [&](Shard &shard) {
+            if (!shard.tree->Add(item)) {
+                return false;
+            }
+            int size = shard.size.load(memory_order_relaxed) + 1;
+            shard.size.store(size, memory_order_relaxed);
+            check = size >= shard.splitCheck.load(memory_order_relaxed);
+            return true;
+        });
+        if (check) {
+            checkBalance();
+        }
+        return added;
+    }
+
+    // remove item, return true if successful
+    bool Remove(const T &item) {
+        bool check = false;
+        bool removed = withShard(item, [&](Shard &shard) {
+            if (!shard.tree->Remove(item)) {
+                return false;
+            }
+            int size = shard.size.load(memory_order_relaxed) - 1;
+            shard.size.store(size, memory_order_relaxed);
+            check = size < shard.mergeCheck.load(memory_order_relaxed);
+            return true;
+        });
+        if (check) {
+            checkBalance();
+        }
+        return removed;
+    }
+
+    // true if item is in its shard
+    bool Contains(const T &item) const {
+        // BST lookups may restructure (splay) or merge pending writes, so
+        // readers lock the shard too
+        return withShard(item, [&](Shard &shard) {
+            return shard.tree->Contains(item);
+        });
+    }
+
+    // inorder traversal over every shard, in key order
+    void InorderTraverse(void visit(const T &item)) const {
+        lock_guard<mutex> guard(topology);
+        for (Shard* shard : layout.load(memory_order_relaxed)->shards) {
+            lock_guard<mutex> shardGuard(shard->lock);
+            shard->tree->InorderTraverse(visit);
+        }
+    }
+
+    // inorder traversal of the items in [lo, hi], visiting only the
+    // shards whose ranges overlap it
+    void RangeTraverse(const T &lo, const T &hi,
+                       void visit(const T &item)) const {
+        if (hi < lo) {
+            return;
+        }
+        lock_guard<mutex> guard(topology);
+        const Layout &current = *layout.load(memory_order_relaxed);
+        int last = shardIndex(current, hi);
+        for (int i = shardIndex(current, lo); i <= last; i++) {
+            lock_guard<mutex> shardGuard(current.shards[i]->lock);
+            current.shards[i]->tree->RangeTraverse(lo, hi, visit);
+        }
+    }
+
+    // rebalance every shard's tree, one shard at a time
+    void Rebalance() {
+        lock_guard<mutex> guard(topology);
+        for (Shard* shard : layout.load(memory_order_relaxed)->shards) {
+            lock_guard<mutex> shardGuard(shard->lock);
+            shard->tree->Rebalance();
+        }
+    }
+
+    // delete all items and go back to a single shard
+    void Clear() {
+        lock_guard<mutex> guard(topology);
+        const Layout &current = *layout.load(memory_order_relaxed);
+        vector<unique_ptr<BST<T>>> dead;
+        {
+            vector<unique_lock<mutex>> guards;
+            for (Shard* shard : current.shards) {
+                guards.emplace_back(shard->lock);
+            }
+            Layout* next = new Layout();
+            next->shards.push_back(new Shard());
+            publish(next, current.shards);
+            for (Shard* shard : current.shards) {
+                dead.push_back(std::move(shard->tree));
+            }
+        }
+        // the old trees are freed here, with no shard locked
+    }
+};
+
+template<class T>
+const int ShardedBST<T>::MIN_SHARD_SIZE;
+
+template<class T>
+const int ShardedBST<T>::READER_SLOTS;
+
+#endif  // SHARDED_BST_HPP
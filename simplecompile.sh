@@ -17,7 +17,8 @@
 date
 
 echo "*** Compiling"
-g++ -std=c++14 -Wall -Wextra -Wno-sign-compare *.cpp -g -o myprogram.exe
+# bst_bench.cpp has its own main, build it with cmake (target bst_bench)
+g++ -std=c++14 -Wall -Wextra -Wno-sign-compare main.cpp bst_test.cpp -g -pthread -o myprogram.exe
 
 echo "*** cpplint"
 cpplint *.cpp *.hpp
@@ -0,0 +1,127 @@
+/**
+ * Static Binary Search Tree - Template
+ *
+ * Read-only BST for a key set fixed at compile time. The constructor is
+ * constexpr: it sorts the keys, drops duplicates (as BST::Add would) and
+ * lays them out as an implicit balanced tree in breadth-first (Eytzinger)
+ * order, where the children of slot k are slots 2k and 2k + 1 (1-based).
+ * No pointers and no heap: a constexpr StaticBST is built by the compiler
+ * and lives in read-only data, and Contains can run at compile time too.
+ *
+ *   constexpr StaticBST<int, 4> reserved({404, 200, 500, 301});
+ *   static_assert(reserved.Contains(301), "");
+ *
+ * Sorting is insertion sort, fine for the small sets this is meant for
+ * but quadratic in N at compile time. T must be a literal type with
+ * == and <, and default constructible.
+ */
+
+#ifndef STATIC_BST_HPP
+#define STATIC_BST_HPP
+
+template<class T, int N>
+class StaticBST {
+    static_assert(N > 0, "StaticBST needs at least one key");
+
+ public:
+    // build the tree from items, duplicates are kept once
+    constexpr explicit StaticBST(const T (&items)[N]) : layout{}, size{0} {
+        T sorted[N] = {};
+        for (int i = 0; i < N; i++) {
+            // insertion sort, skipping items already present
+            int pos = size;
+            while (pos > 0 && items[i] < sorted[pos - 1]) {
+                pos--;
+            }
+            if (pos > 0 && sorted[pos - 1] == items[i]) {
+                continue;
+            }
+            for (int j = size; j > pos; j--) {
+                sorted[j] = sorted[j - 1];
+            }
+            sorted[pos] = items[i];
+            size++;
+        }
+        fillLayout(sorted, 0, 1);
+    }
+
+    // true if the tree holds no keys, never the case for N > 0 input
+    constexpr bool IsEmpty() const {
+        return size == 0;
+    }
+
+    // number of distinct keys
+    constexpr int NumberOfNodes() const {
+        return size;
+    }
+
+    // height of the implicit tree, the fewest levels that hold every key
+    constexpr int getHeight() const {
+        int height = 0;
+        while ((1 << height) - 1 < size) {
+            height++;
+        }
+        return height;
+    }
+
+    // true if item is in the tree, same comparisons as BST::Contains
+    constexpr bool Contains(const T &item) const {
+        int k = 1;
+        while (k <= size) {
+            const T &current = layout[k - 1];
+            if (current == item) {
+                return true;
+            }
+            k = 2 * k + (current < item ? 1 : 0);
+        }
+        return false;
+    }
+
+    // inorder traversal: left-root-right
+    void InorderTraverse(void visit(const T &item)) const {
+        inorderHelper(visit, 1);
+    }
+
+ private:
+    // keys in breadth-first order of the implicit tree
+    T layout[N];
+
+    // number of distinct keys, slots past it are unused
+    int size;
+
+    /**
+     * Fills the subtree at slot k with sorted[next..] in order
+     * @param sorted - distinct keys in order
+     * @param next - index of the next key to place
+     * @param k - 1-based slot of the subtree root
+     * @return index of the next key after this subtree
+     */
+    constexpr int fillLayout(const T (&sorted)[N], int next, int k) {
+        if (k > size) {
+            return next;
+        }
+        next = fillLayout(sorted, next, 2 * k);
+        layout[k - 1] = sorted[next++];
+        return fillLayout(sorted, next, 2 * k + 1);
+    }
+
+    void inorderHelper(void visit(const T &item), int k) const {
+        if (k <= size) {
+            inorderHelper(visit, 2 * k);
+            visit(layout[k - 1]);
+            inorderHelper(visit, 2 * k + 1);
+        }
+    }
+};
+
+/**
+ * Builds a StaticBST with N taken from the array, e.g.
+ *   constexpr int codes[] = {3, 1, 2};
+ *   constexpr auto tree = MakeStaticBST(codes);
+ */
+template<class T, int N>
+constexpr StaticBST<T, N> MakeStaticBST(const T (&items)[N]) {
+    return StaticBST<T, N>(items);
+}
+
+#endif  // STATIC_BST_HPP